@@ -0,0 +1,42 @@
+#!/bin/bash
+# binarize all pages of each register in parallel, then segment the whole register from a work queue
+# rerunning the script resumes an interrupted register, more engines on other nodes can join with
+#   make -C src queue manifest=<register>/manifest.txt queue_dir=<register>/queue config=...
+
+#include file paths
+source file_paths.sh
+
+Nproc=${Nproc:-`nproc`}  # number of binarization processes and segmentation workers running in parallel
+
+binarize() {
+	image=$1
+	outdir=$2
+	prefix=$(basename $image .png)
+	[ -f $outdir/$prefix/${prefix}_bin.bmp ] && return  # binarized by an earlier run
+	mkdir -p $outdir/$prefix
+	make -s -C $MAKE_DIR preprocess image=$image outdir=$outdir/$prefix prefix=$prefix
+}
+export -f binarize
+export MAKE_DIR
+
+all_registers=(`ls $IMAGE_DIR`)
+
+for register in ${all_registers[@]}; do
+
+	all_images=(`ls $IMAGE_DIR/$register/*.png`)
+	image_cnt=${#all_images[@]}
+	echo "Found $image_cnt PNG images in register $register"
+	mkdir -p $OUT_DIR/$register
+
+	# one line per page: <binarized image> <output directory> <prefix>
+	manifest=$OUT_DIR/$register/manifest.txt
+	: > $manifest
+	for image in ${all_images[@]}; do
+		prefix=$(basename $image .png)
+		echo "$OUT_DIR/$register/$prefix/${prefix}_bin.bmp $OUT_DIR/$register/$prefix $prefix" >> $manifest
+	done
+
+	printf "%s\n" ${all_images[@]} | xargs -P $Nproc -I{} bash -c "binarize {} $OUT_DIR/$register"
+	make -C $MAKE_DIR queue manifest=$manifest queue_dir=$OUT_DIR/$register/queue workers=$Nproc dumpall=1 config=$CONFIG
+
+done
@@ -0,0 +1,173 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include "BatchReport.h"
+#include "MsgPrint.h"
+
+using std::lock_guard;
+using std::mutex;
+using std::sort;
+
+static const char *STAGE_NAMES[BatchReport::STAGE_COUNT] = {"read", "segment", "write", "total"};
+static const double QUANTILES[] = {0.5, 0.95, 0.99};
+static const int QUANTILE_CNT = 3;
+
+BatchReport::BatchReport(const string &summaryFile, const string &metricsFile, int slowestCnt, double interval) {
+	this->summaryFile = summaryFile;
+	this->metricsFile = metricsFile;
+	this->slowestCnt = (slowestCnt > 0) ? slowestCnt : 0;
+	this->interval = interval;
+	start();
+}
+
+double BatchReport::nowSec() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BatchReport::start() {
+	lock_guard<mutex> lock(mtx);
+	startSec = lastWriteSec = nowSec();
+	pages.clear();
+	words = 0;
+	failedCnt = upToDateCnt = reusedCnt = 0;
+}
+
+void BatchReport::addPage(const Page &page) {
+	lock_guard<mutex> lock(mtx);
+	pages.push_back(page);
+	words += page.words;
+}
+
+void BatchReport::addFailed() {
+	lock_guard<mutex> lock(mtx);
+	++failedCnt;
+}
+
+void BatchReport::addSkipped(bool upToDate) {
+	lock_guard<mutex> lock(mtx);
+	++(upToDate ? upToDateCnt : reusedCnt);
+}
+
+void BatchReport::writeIfDue() {
+	if (interval <= 0)
+		return;
+	{
+		lock_guard<mutex> lock(mtx);
+		if (nowSec() - lastWriteSec < interval)
+			return;
+	}
+	write();
+}
+
+// both files are replaced at once, so a reader or a metrics scraper never sees half a file
+static bool replaceFile(const string &fileName, const string &tmpName) {
+	if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+		remove(tmpName.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool BatchReport::write() {
+	lock_guard<mutex> lock(mtx);
+	lastWriteSec = nowSec();
+	for (int s = 0; s < STAGE_COUNT; ++s) {
+		sortedMs[s].resize(pages.size());
+		for (size_t i = 0; i < pages.size(); ++i)
+			sortedMs[s][i] = pages[i].ms[s];
+		sort(sortedMs[s].begin(), sortedMs[s].end());
+	}
+	bool ok = true;
+	if (!writeSummary(summaryFile + ".tmp") || !replaceFile(summaryFile, summaryFile + ".tmp")) {
+		MsgPrint::msgPrint(MsgPrint::WARN, ("Cannot write batch report " + summaryFile).c_str());
+		ok = false;
+	}
+	if (!writeMetrics(metricsFile + ".tmp") || !replaceFile(metricsFile, metricsFile + ".tmp")) {
+		MsgPrint::msgPrint(MsgPrint::WARN, ("Cannot write batch metrics " + metricsFile).c_str());
+		ok = false;
+	}
+	return ok;
+}
+
+double BatchReport::percentile(int stage, double p) const {
+	const vector<double> &v = sortedMs[stage];
+	if (v.empty())
+		return 0;
+	size_t rank = (size_t)ceil(p * v.size());
+	return v[(rank > 0) ? rank-1 : 0];
+}
+
+bool BatchReport::writeSummary(const string &fileName) const {
+	FILE *f = fopen(fileName.c_str(), "w");
+	if (f == NULL)
+		return false;
+	double elapsed = nowSec() - startSec;
+	size_t finished = pages.size() + failedCnt + upToDateCnt + reusedCnt;
+	fprintf(f, "pages          %zu finished: %zu processed, %zu up to date, %zu reused, %zu failed\n",
+			finished, pages.size(), upToDateCnt, reusedCnt, failedCnt);
+	fprintf(f, "elapsed        %.3f s\n", elapsed);
+	fprintf(f, "throughput     %.3f pages/s, %.1f words/s, processed pages only\n",
+			(elapsed > 0) ? pages.size() / elapsed : 0, (elapsed > 0) ? words / elapsed : 0);
+	fprintf(f, "\nlatency ms         p50        p95        p99        max\n");
+	for (int s = 0; s < STAGE_COUNT; ++s) {
+		fprintf(f, "  %-8s", STAGE_NAMES[s]);
+		for (int q = 0; q < QUANTILE_CNT; ++q)
+			fprintf(f, " %10.1f", percentile(s, QUANTILES[q]));
+		fprintf(f, " %10.1f\n", sortedMs[s].empty() ? 0 : sortedMs[s].back());
+	}
+
+	// slowest first, ties in manifest order
+	vector<size_t> order(pages.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	size_t n = std::min(order.size(), (size_t)slowestCnt);
+	std::partial_sort(order.begin(), order.begin() + n, order.end(), [this](size_t a, size_t b) {
+		return (pages[a].ms[TOTAL] != pages[b].ms[TOTAL]) ? pages[a].ms[TOTAL] > pages[b].ms[TOTAL] : a < b;
+	});
+	fprintf(f, "\nslowest pages\n");
+	fprintf(f, "  total_ms    read_ms segment_ms   write_ms  width height charH components regions words image\n");
+	for (size_t k = 0; k < n; ++k) {
+		const Page &p = pages[order[k]];
+		fprintf(f, "  %8.1f %10.1f %10.1f %10.1f %6d %6d %5d %10d %7d %5d %s\n", p.ms[TOTAL], p.ms[READ], p.ms[SEGMENT], p.ms[WRITE],
+				p.width, p.height, p.charH, p.components, p.regions, p.words, p.image.c_str());
+	}
+	return fclose(f) == 0;
+}
+
+bool BatchReport::writeMetrics(const string &fileName) const {
+	FILE *f = fopen(fileName.c_str(), "w");
+	if (f == NULL)
+		return false;
+	double elapsed = nowSec() - startSec;
+	fprintf(f, "# HELP engine_batch_pages_total Pages finished by the batch.\n");
+	fprintf(f, "# TYPE engine_batch_pages_total counter\n");
+	fprintf(f, "engine_batch_pages_total{status=\"processed\"} %zu\n", pages.size());
+	fprintf(f, "engine_batch_pages_total{status=\"up_to_date\"} %zu\n", upToDateCnt);
+	fprintf(f, "engine_batch_pages_total{status=\"reused\"} %zu\n", reusedCnt);
+	fprintf(f, "engine_batch_pages_total{status=\"failed\"} %zu\n", failedCnt);
+	fprintf(f, "# HELP engine_batch_words_total Words extracted from processed pages.\n");
+	fprintf(f, "# TYPE engine_batch_words_total counter\n");
+	fprintf(f, "engine_batch_words_total %lld\n", (long long)words);
+	fprintf(f, "# HELP engine_batch_elapsed_seconds Time since the batch started.\n");
+	fprintf(f, "# TYPE engine_batch_elapsed_seconds gauge\n");
+	fprintf(f, "engine_batch_elapsed_seconds %.3f\n", elapsed);
+	fprintf(f, "# HELP engine_batch_pages_per_second Processed pages per second since the batch started.\n");
+	fprintf(f, "# TYPE engine_batch_pages_per_second gauge\n");
+	fprintf(f, "engine_batch_pages_per_second %.6f\n", (elapsed > 0) ? pages.size() / elapsed : 0);
+	fprintf(f, "# HELP engine_batch_words_per_second Words per second since the batch started.\n");
+	fprintf(f, "# TYPE engine_batch_words_per_second gauge\n");
+	fprintf(f, "engine_batch_words_per_second %.6f\n", (elapsed > 0) ? words / elapsed : 0);
+	fprintf(f, "# HELP engine_batch_page_seconds Latency of processed pages by stage, total is from claiming to writing a page.\n");
+	fprintf(f, "# TYPE engine_batch_page_seconds summary\n");
+	for (int s = 0; s < STAGE_COUNT; ++s) {
+		double sum = 0;
+		for (size_t i = 0; i < sortedMs[s].size(); ++i)
+			sum += sortedMs[s][i];
+		for (int q = 0; q < QUANTILE_CNT; ++q)
+			fprintf(f, "engine_batch_page_seconds{stage=\"%s\",quantile=\"%g\"} %.6f\n", STAGE_NAMES[s], QUANTILES[q], percentile(s, QUANTILES[q]) / 1000);
+		fprintf(f, "engine_batch_page_seconds_sum{stage=\"%s\"} %.6f\n", STAGE_NAMES[s], sum / 1000);
+		fprintf(f, "engine_batch_page_seconds_count{stage=\"%s\"} %zu\n", STAGE_NAMES[s], sortedMs[s].size());
+	}
+	return fclose(f) == 0;
+}
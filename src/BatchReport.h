@@ -0,0 +1,58 @@
+#ifndef __BATCHREPORT_H__
+#define __BATCHREPORT_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+using std::string;
+using std::vector;
+
+// throughput and per-page latency of a batch run
+// written as a text summary with the slowest pages and as a Prometheus text format snapshot,
+// at the end of the run and every interval seconds while pages are finished
+class BatchReport {
+public:
+	enum STAGE {READ, SEGMENT, WRITE, TOTAL, STAGE_COUNT};
+
+	// one processed page, latencies in ms, TOTAL is from claiming the page to having written it
+	struct Page {
+		string image;
+		int width, height, charH;
+		int components, regions, words;
+		double ms[STAGE_COUNT];
+	};
+
+	// summaryFile, metricsFile: written by write, slowestCnt: pages listed in the summary
+	// interval: seconds between snapshots during the run, 0: only at the end
+	BatchReport(const string &summaryFile, const string &metricsFile, int slowestCnt, double interval);
+	// start the clock of the run and forget all pages
+	void start();
+	void addPage(const Page &page);
+	void addFailed();
+	void addSkipped(bool upToDate);
+	// write both files if interval seconds passed since the last time
+	void writeIfDue();
+	// return false if a file cannot be written
+	bool write();
+
+private:
+	static double nowSec();
+	bool writeSummary(const string &fileName) const;
+	bool writeMetrics(const string &fileName) const;
+	// nearest rank percentile of the stage over all pages, 0 <= p <= 1
+	double percentile(int stage, double p) const;
+
+	string summaryFile, metricsFile;
+	int slowestCnt;
+	double interval;
+
+	mutable std::mutex mtx;
+	double startSec, lastWriteSec;
+	vector<Page> pages;
+	vector<double> sortedMs[STAGE_COUNT];  // latencies of all pages, sorted by write
+	int64_t words;
+	size_t failedCnt, upToDateCnt, reusedCnt;
+};
+
+#endif
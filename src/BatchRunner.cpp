@@ -0,0 +1,325 @@
+#include <cstdio>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <sys/stat.h>
+#include "BatchRunner.h"
+#include "HandwrittenImage.h"
+#include "ThreadPool.h"
+#include "ResultCache.h"
+#include "BatchReport.h"
+#include "Timeline.h"
+#include "MsgPrint.h"
+
+using std::ifstream;
+using std::istringstream;
+using std::lock_guard;
+using std::mutex;
+using std::make_pair;
+using std::sort;
+
+bool BatchRunner::makeDirs(const string &path) {
+	for (size_t pos = 1; pos <= path.length(); ++pos) {
+		if (pos == path.length() || path[pos] == '/') {
+			string dir = path.substr(0, pos);
+			if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+				return false;
+		}
+	}
+	return true;
+}
+
+vector<PageJob> BatchRunner::readManifest(const char *fileName) {
+	ifstream f(fileName);
+	if (!f.is_open()) {
+		char msg[1000];
+		sprintf(msg, "Cannot open manifest file %s.", fileName);
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+
+	vector<PageJob> jobs;
+	string line;
+	while (getline(f, line)) {
+		istringstream ss(line);
+		PageJob job;
+		if (!(ss >> job.image) || job.image[0] == '#')
+			continue;
+		size_t slash = job.image.rfind('/');
+		if (!(ss >> job.outdir))
+			job.outdir = (slash == string::npos) ? "." : job.image.substr(0, slash);
+		if (!(ss >> job.prefix)) {
+			job.prefix = (slash == string::npos) ? job.image : job.image.substr(slash+1);
+			size_t dot = job.prefix.rfind('.');
+			if (dot != string::npos && dot > 0)
+				job.prefix = job.prefix.substr(0, dot);
+		}
+		if (job.outdir[job.outdir.length()-1] != '/')
+			job.outdir += '/';
+		jobs.push_back(job);
+	}
+	return jobs;
+}
+
+struct BatchRunner::PageSlot {
+	HandwrittenImage img;
+	StageProfile profile;
+	size_t job;  // index of the page in jobs
+	const char *name;  // page name in the timeline, NULL if it is not recording
+	double claimedMs;  // when the page was claimed
+	BatchReport::Page report;  // filled in stage by stage
+};
+
+static double nowMs() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// every job of the list, in order
+class AllPages : public PageSource {
+public:
+	AllPages(size_t n) : n(n), nextIndex(0) {}
+	bool next(size_t &index) {
+		if (nextIndex >= n)
+			return false;
+		index = nextIndex++;
+		return true;
+	}
+	void finish(size_t, const string &) {}
+private:
+	size_t n, nextIndex;
+};
+
+BatchRunner::BatchRunner(const map<string, double> &configs, int workerCnt, bool dumpall, ThreadPool *pool)
+	: freeSlots((workerCnt > 0 ? workerCnt : std::max(1u, std::thread::hardware_concurrency())) + 4), readPages(1), segmentedPages(1) {
+	this->configs = configs;
+	this->workerCnt = (workerCnt > 0) ? workerCnt : std::max(1u, std::thread::hardware_concurrency());
+	this->dumpall = dumpall;
+	this->profiling = (configs.at("profile") != 0);
+	this->threadPool = pool;
+	resultCache = NULL;
+	report = NULL;
+	jobs = NULL;
+	source = NULL;
+	claimedCnt = upToDateCnt = reusedCnt = 0;
+	for (int i = 0; i < this->workerCnt + 4; ++i) {
+		slots.push_back(new PageSlot());
+		slots.back()->img.setThreadPool(pool);
+		freeSlots.push(slots.back());
+	}
+}
+
+BatchRunner::~BatchRunner() {
+	for (size_t i = 0; i < slots.size(); ++i)
+		delete slots[i];
+}
+
+// run one stage of a page, a failure is recorded and the page is dropped from the pipeline
+// return true if the stage succeeded
+bool BatchRunner::runStage(size_t index, const function<void()> &stage) {
+	MsgPrint::setContext((*jobs)[index].prefix.c_str());
+	string error;
+	try {
+		stage();
+	}
+	catch (const MsgPrint::Error &e) {
+		error = e.what();
+	}
+	catch (const std::exception &e) {
+		error = e.what();
+		MsgPrint::msgPrint(MsgPrint::WARN, error.c_str());
+	}
+	if (!error.empty()) {
+		{
+			lock_guard<mutex> lock(mtx);
+			failures.push_back(make_pair(index, error));
+		}
+		if (report != NULL)
+			report->addFailed();
+		source->finish(index, error);
+	}
+	MsgPrint::setContext(NULL);
+	return error.empty();
+}
+
+// in the timeline, every page is an async span from claiming to writing, and each stage a span of its thread
+// waiting on a full or empty queue shows as a wait span: stalls of the reader, idle segmenters, writer back-pressure
+void BatchRunner::readStage() {
+	Timeline::setThreadName("reader");
+	size_t index;
+	while (source->next(index)) {
+		double claimedMs = nowMs();
+		++claimedCnt;
+		const PageJob &job = (*jobs)[index];
+		const char *pageName = Timeline::enabled() ? Timeline::intern(job.prefix) : NULL;
+		Timeline::asyncBegin("page", "page", pageName, index);
+		if (resultCache != NULL) {
+			ResultCache::STATUS status = ResultCache::MISSING;
+			bool ok;
+			{
+				Timeline::Span span("lookupResults", "page", pageName, index);
+				ok = runStage(index, [&] { status = resultCache->lookup(index); });
+			}
+			if (!ok) {
+				Timeline::asyncEnd("page", "page", pageName, index);
+				continue;
+			}
+			if (status != ResultCache::MISSING) {
+				++(status == ResultCache::UPTODATE ? upToDateCnt : reusedCnt);
+				if (report != NULL)
+					report->addSkipped(status == ResultCache::UPTODATE);
+				source->finish(index, "");
+				Timeline::asyncEnd("page", "page", pageName, index);
+				continue;
+			}
+		}
+		PageSlot *slot;
+		{
+			Timeline::Span span("waitFreeSlot", "wait");
+			freeSlots.pop(slot);
+		}
+		slot->job = index;
+		slot->name = pageName;
+		slot->claimedMs = claimedMs;
+		slot->report.image = job.image;
+		bool ok;
+		{
+			Timeline::Span span("readPage", "page", pageName, index);
+			double t = nowMs();
+			ok = runStage(index, [&] { readPage(slot->img, job, dumpall, profiling ? &slot->profile : NULL); });
+			slot->report.ms[BatchReport::READ] = nowMs() - t;
+		}
+		if (ok) {
+			Timeline::Span span("waitReadQueue", "wait");
+			readPages.push(slot);
+		}
+		else {
+			Timeline::asyncEnd("page", "page", pageName, index);
+			freeSlots.push(slot);
+		}
+	}
+	readPages.close();
+}
+
+void BatchRunner::segmentStage(int worker) {
+	Timeline::setThreadName("segmenter " + std::to_string(worker));
+	PageSlot *slot;
+	while (true) {
+		bool ok;
+		{
+			Timeline::Span span("waitReadPage", "wait");
+			ok = readPages.pop(slot);
+		}
+		if (!ok)
+			break;
+		{
+			Timeline::Span span("segmentPage", "page", slot->name, slot->job);
+			double t = nowMs();
+			ok = runStage(slot->job, [&] { segmentPage(slot->img, (*jobs)[slot->job], configs, profiling ? &slot->profile : NULL); });
+			slot->report.ms[BatchReport::SEGMENT] = nowMs() - t;
+		}
+		if (ok) {
+			BatchReport::Page &page = slot->report;
+			page.width = slot->img.getWidth();
+			page.height = slot->img.getHeight();
+			page.charH = slot->img.getCharH();
+			page.components = slot->img.getComponentCount();
+			page.regions = slot->img.getRegionCount();
+			page.words = slot->img.getWordBoxes().size();
+		}
+		if (ok) {
+			Timeline::Span span("waitWriteQueue", "wait");
+			segmentedPages.push(slot);
+		}
+		else {
+			Timeline::asyncEnd("page", "page", slot->name, slot->job);
+			freeSlots.push(slot);
+		}
+	}
+	// the last segmenting worker closes the write queue
+	if (--activeSegmenters == 0)
+		segmentedPages.close();
+}
+
+void BatchRunner::writeStage() {
+	Timeline::setThreadName("writer");
+	PageSlot *slot;
+	while (true) {
+		bool ok;
+		{
+			Timeline::Span span("waitSegmentedPage", "wait");
+			ok = segmentedPages.pop(slot);
+		}
+		if (!ok)
+			break;
+		const PageJob &job = (*jobs)[slot->job];
+		{
+			Timeline::Span span("writePage", "page", slot->name, slot->job);
+			double t = nowMs();
+			ok = runStage(slot->job, [&] {
+				if (!makeDirs(job.outdir))
+					MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot create output directory " + job.outdir).c_str());
+				vector<string> files = writePageOutputs(slot->img, job, dumpall, profiling ? &slot->profile : NULL);
+				if (resultCache != NULL)
+					resultCache->store(slot->job, files);
+			});
+			slot->report.ms[BatchReport::WRITE] = nowMs() - t;
+		}
+		if (ok)
+			source->finish(slot->job, "");
+		if (ok && report != NULL) {
+			slot->report.ms[BatchReport::TOTAL] = nowMs() - slot->claimedMs;
+			report->addPage(slot->report);
+			report->writeIfDue();
+		}
+		Timeline::asyncEnd("page", "page", slot->name, slot->job);
+		freeSlots.push(slot);
+	}
+}
+
+int BatchRunner::run(const vector<PageJob> &jobs, PageSource *source) {
+	char msg[1000];
+	sprintf(msg, "Processing %zu pages with %d workers ......", jobs.size(), workerCnt);
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+
+	AllPages allPages(jobs.size());
+	this->source = (source != NULL) ? source : &allPages;
+	claimedCnt = upToDateCnt = reusedCnt = 0;
+	if (report != NULL)
+		report->start();
+
+	// ERR messages throw instead of exiting, so that one bad page does not abort the batch
+	MsgPrint::setErrAction(MsgPrint::THROW);
+	this->jobs = &jobs;
+	failures.clear();
+	readPages.reopen();
+	segmentedPages.reopen();
+	activeSegmenters = workerCnt;
+
+	// the calling thread writes
+	vector<std::thread> stages;
+	stages.push_back(std::thread(&BatchRunner::readStage, this));
+	for (int i = 0; i < workerCnt; ++i)
+		stages.push_back(std::thread(&BatchRunner::segmentStage, this, i+1));
+	writeStage();
+	for (size_t i = 0; i < stages.size(); ++i)
+		stages[i].join();
+	MsgPrint::setErrAction(MsgPrint::EXIT);
+	this->jobs = NULL;
+	this->source = NULL;
+
+	sort(failures.begin(), failures.end());
+	for (size_t i = 0; i < failures.size(); ++i) {
+		sprintf(msg, "Page %s failed: %s", jobs[failures[i].first].image.c_str(), failures[i].second.c_str());
+		MsgPrint::msgPrint(MsgPrint::WARN, msg);
+	}
+	if (resultCache != NULL)
+		sprintf(msg, "Processed %zu pages, %zu up to date, %zu reused, %zu failed.", claimedCnt, upToDateCnt, reusedCnt, failures.size());
+	else
+		sprintf(msg, "Processed %zu pages, %zu failed.", claimedCnt, failures.size());
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+	if (report != NULL)
+		report->write();
+	return failures.size();
+}
@@ -0,0 +1,86 @@
+#ifndef __BATCHRUNNER_H__
+#define __BATCHRUNNER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "PageProcessor.h"
+#include "BoundedQueue.h"
+using std::map;
+using std::string;
+using std::vector;
+using std::function;
+
+class ThreadPool;
+class ResultCache;
+class BatchReport;
+
+// where a batch takes its pages from, pages are indices into the job list given to BatchRunner::run
+class PageSource {
+public:
+	virtual ~PageSource() {}
+	// claim the next page to process, return false when no page is left
+	virtual bool next(size_t &index) = 0;
+	// called once for every claimed page, when it is written or has failed, error is empty on success
+	virtual void finish(size_t index, const string &error) = 0;
+};
+
+// segment many pages in one process
+// pages go through a pipeline of three stages connected by bounded queues: read, segment and write
+// so the next page is read and the previous one is written while pages are segmented
+// a fixed set of HandwrittenImage buffers circulates through the stages, page buffers are reused from page to page
+// a failing page is reported and skipped, the rest of the batch goes on
+class BatchRunner {
+public:
+	// workerCnt: number of pages segmented at the same time, 0: one per hardware thread
+	// pool: thread pool shared by all segmenting workers for intra-page parallel loops, can be NULL
+	BatchRunner(const map<string, double> &configs, int workerCnt, bool dumpall, ThreadPool *pool);
+	~BatchRunner();
+	// skip pages whose outputs are up to date or can be copied from an identical page, the cache must be built on the jobs of run
+	void setResultCache(ResultCache *cache) { resultCache = cache; }
+	// record the latency of every page, the report is written at the end of each run and periodically during it
+	void setReport(BatchReport *report) { this->report = report; }
+	// process the jobs claimed from source, all jobs if source is NULL, return the number of failed pages
+	int run(const vector<PageJob> &jobs, PageSource *source = NULL);
+
+	// manifest: one page per line, "<1-bit BMP image> [<output directory> [<output prefix>]]"
+	// output directory defaults to the image directory, prefix defaults to the image name without extension
+	// empty lines and lines starting with '#' are skipped
+	static vector<PageJob> readManifest(const char *fileName);
+	// mkdir -p
+	static bool makeDirs(const string &path);
+
+private:
+	struct PageSlot;
+
+	bool runStage(size_t index, const function<void()> &stage);
+	void readStage();
+	void segmentStage(int worker);
+	void writeStage();
+
+	map<string, double> configs;
+	int workerCnt;
+	bool dumpall;
+	bool profiling;  // write a stage profile for every page
+	ThreadPool *threadPool;
+	ResultCache *resultCache;
+	BatchReport *report;
+
+	const vector<PageJob> *jobs;  // jobs of the current run
+	PageSource *source;  // pages of the current run
+	size_t claimedCnt;
+	size_t upToDateCnt, reusedCnt;
+	vector<PageSlot *> slots;  // page buffers: one per segmenting worker, plus one being read, two queued and one being written
+	BoundedQueue<PageSlot *> freeSlots;
+	BoundedQueue<PageSlot *> readPages;  // read, waiting to be segmented
+	BoundedQueue<PageSlot *> segmentedPages;  // segmented, waiting to be written
+	std::atomic<int> activeSegmenters;
+
+	std::mutex mtx;
+	vector< std::pair<size_t, string> > failures;  // (job index, error message)
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __BOUNDEDQUEUE_H__
+#define __BOUNDEDQUEUE_H__
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+using std::queue;
+
+// a blocking FIFO queue holding at most capacity items, connects pipeline stages running in different threads
+template <class T>
+class BoundedQueue {
+public:
+	BoundedQueue(size_t capacity);
+	// block while the queue is full, return false if the queue is closed
+	bool push(const T &item);
+	// block while the queue is empty and open, return false once the queue is closed and drained
+	bool pop(T &item);
+	// nothing more will be pushed, wake up all waiting threads
+	void close();
+	// open a drained queue again
+	void reopen();
+
+private:
+	queue<T> items;
+	size_t capacity;
+	bool closed;
+	std::mutex mtx;
+	std::condition_variable notFull, notEmpty;
+};
+
+template <class T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) {
+	this->capacity = (capacity > 0) ? capacity : 1;
+	closed = false;
+}
+
+template <class T>
+bool BoundedQueue<T>::push(const T &item) {
+	std::unique_lock<std::mutex> lock(mtx);
+	notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+	if (closed)
+		return false;
+	items.push(item);
+	notEmpty.notify_one();
+	return true;
+}
+
+template <class T>
+bool BoundedQueue<T>::pop(T &item) {
+	std::unique_lock<std::mutex> lock(mtx);
+	notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+	if (items.empty())
+		return false;
+	item = items.front();
+	items.pop();
+	notFull.notify_one();
+	return true;
+}
+
+template <class T>
+void BoundedQueue<T>::close() {
+	std::lock_guard<std::mutex> lock(mtx);
+	closed = true;
+	notFull.notify_all();
+	notEmpty.notify_all();
+}
+
+template <class T>
+void BoundedQueue<T>::reopen() {
+	std::lock_guard<std::mutex> lock(mtx);
+	closed = false;
+}
+
+#endif
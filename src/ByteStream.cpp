@@ -0,0 +1,96 @@
+#include <cstring>
+#include "ByteStream.h"
+
+void ByteWriter::putUint(uint64_t v) {
+	while (v >= 0x80) {
+		bytes.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	bytes.push_back((uint8_t)v);
+}
+
+void ByteWriter::putInt(int64_t v) {
+	putUint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+void ByteWriter::putDouble(double v) {
+	uint64_t u;
+	memcpy(&u, &v, sizeof(u));
+	for (int i = 0; i < 8; ++i)
+		bytes.push_back((uint8_t)(u >> (8*i)));
+}
+
+void ByteWriter::putPlane(const vector< vector<int32_t> > &pix) {
+	putUint(pix.size());
+	putUint(pix.empty() ? 0 : pix[0].size());
+	int64_t last = 0;
+	for (size_t x = 0; x < pix.size(); ++x) {
+		const vector<int32_t> &col = pix[x];
+		for (size_t y = 0; y < col.size(); ) {
+			size_t st = y;
+			for (++y; y < col.size() && col[y] == col[st]; ++y);
+			putInt(col[st] - last);
+			putUint(y - st);
+			last = col[st];
+		}
+	}
+}
+
+uint64_t ByteReader::getUint() {
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos >= len)
+			break;
+		uint8_t b = data[pos++];
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+			return v;
+	}
+	failed = true;
+	return 0;
+}
+
+int64_t ByteReader::getInt() {
+	uint64_t u = getUint();
+	return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+double ByteReader::getDouble() {
+	if (len - pos < 8) {
+		failed = true;
+		return 0;
+	}
+	uint64_t u = 0;
+	for (int i = 0; i < 8; ++i)
+		u |= (uint64_t)data[pos++] << (8*i);
+	double v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+void ByteReader::getPlane(vector< vector<int32_t> > &pix, int width, int height) {
+	uint64_t w = getUint(), h = getUint();
+	if (w == 0) {
+		vector< vector<int32_t> >().swap(pix);
+		return;
+	}
+	if (failed || w != (uint64_t)width || h != (uint64_t)height) {
+		failed = true;
+		return;
+	}
+	pix.resize(width);
+	int64_t last = 0;
+	for (int x = 0; x < width; ++x) {
+		pix[x].resize(height);
+		for (int y = 0; y < height; ) {
+			last += getInt();
+			uint64_t run = getUint();
+			if (failed || run == 0 || run > (uint64_t)(height - y)) {
+				failed = true;
+				return;
+			}
+			for (uint64_t i = 0; i < run; ++i)
+				pix[x][y++] = (int32_t)last;
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef __BYTESTREAM_H__
+#define __BYTESTREAM_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+using std::vector;
+
+// compact binary encoding of stage results, integers are varints, pixel planes are run-length encoded
+class ByteWriter {
+public:
+	void putUint(uint64_t v);
+	void putInt(int64_t v);  // zigzag encoded, small negative values stay short
+	void putDouble(double v);
+	// plane indexed [x][y], runs of equal values are stored column by column, run values as differences to the previous run
+	void putPlane(const vector< vector<int32_t> > &pix);
+
+	vector<uint8_t> bytes;
+};
+
+// reads what ByteWriter wrote, reading past the end or malformed data sets failed and yields zeros
+class ByteReader {
+public:
+	ByteReader(const uint8_t *data, size_t len) : data(data), len(len), pos(0), failed(false) {}
+	uint64_t getUint();
+	int64_t getInt();
+	double getDouble();
+	// the plane must be empty or width x height, otherwise failed is set
+	void getPlane(vector< vector<int32_t> > &pix, int width, int height);
+	bool atEnd() const { return pos == len; }
+
+	const uint8_t *data;
+	size_t len, pos;
+	bool failed;
+};
+
+#endif
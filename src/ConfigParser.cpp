@@ -7,6 +7,10 @@
 using std::ifstream;
 using std::string;
 
+ConfigParser::ConfigParser() {
+	setDefaultConfigs();
+}
+
 ConfigParser::ConfigParser(const char *configFile) {
 	configs.clear();
 	setDefaultConfigs();
@@ -73,6 +77,18 @@ void ConfigParser::setDefaultConfigs() {
 	configs["border_removal_horizontal_segment_weight"] = 0.3;
 	configs["border_removal_vertial_segment_weight"] = 1.0;
 	configs["border_removal_segment_sum_threshold"] = 0.05; // unit image height
+	configs["threads"] = 1;  // number of threads working on one page, 0: one per hardware thread
+	configs["queue_lease_timeout"] = 300;  // seconds, a page leased by a batch process that stopped its heartbeat is taken over after this time
+	configs["tile_memory_budget"] = 0;  // MB of pixel planes per page, run the blur, derivative and border stages band by band and free planes once consumed, at least 3 whole-page int32 planes are needed, 0: whole page at once
+	configs["stage_cache"] = 0;  // 1: keep checkpoints of the stage results in <outdir>/<prefix>_stages, a rerun resumes at the first stage whose configs changed
+	configs["profile"] = 0;  // 1: write wall time, CPU time and memory of every stage to <outdir>/<prefix>_profile.json
+	configs["profile_counters"] = 0;  // 1: with profile, also count cycles, instructions, LLC and branch misses of every stage
+	configs["timeline"] = 0;  // 1: write a Chrome trace event timeline of stages, line tasks, pages and I/O of every thread
+	configs["skip_unchanged_pages"] = 1;  // batch: skip pages whose outputs are up to date, copy outputs of identical pages, 0: process every page
+	configs["batch_report"] = 10;  // batch: write throughput, latency percentiles and this many slowest pages to <manifest>_report.txt and <manifest>_metrics.prom, 0: no report
+	configs["batch_report_interval"] = 60;  // seconds between batch report snapshots during a run, 0: only at the end
+	configs["serve_queue_limit"] = 4;  // serve: page requests waiting for a free worker, further requests are answered BUSY
+	configs["serve_max_connections"] = 64;  // serve: open client connections, further connections are answered BUSY and closed
 }
 
 map<string, double> ConfigParser::getConfigs() const {
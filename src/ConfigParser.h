@@ -11,6 +11,8 @@ using std::vector;
 class ConfigParser {
 public:
 	ConfigParser(const char* configFile);
+	// default configs only
+	ConfigParser();
 	map<string, double> getConfigs() const;
 private:
 	void setDefaultConfigs();
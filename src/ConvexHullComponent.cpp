@@ -1,64 +1,54 @@
 #include <algorithm>
 #include <climits>
+#include <cmath>
 #include <cassert>
 #include <unordered_map>
-#include <queue>
 #include <vector>
 #include <cstdlib>
 #include <utility>
 #include "HandwrittenImage.h"
 #include "ConvexHullComponent.h"
 #include "Point.h"
+#include "ByteStream.h"
+#include "StageProfile.h"
+#include "SpanFill.h"
 
 using std::min;
 using std::max;
-using std::queue;
 using std::vector;
 using std::pair;
 using std::make_pair;
 using std::unordered_map;
 using std::abs;
 
-ConvexHullComponent::ConvexHullComponent (HandwrittenImage::PIXELS &pix, int xCoord, int yCoord, int mark) {
+ConvexHullComponent::ConvexHullComponent (const HandwrittenImage::PIXELS &lineMap, HandwrittenImage::PIXELS &pix, int xCoord, int yCoord, int mark) {
 	assert(pix.size() != 0);
 
 	wordID = -1;
-	regionID = pix[xCoord][yCoord];
-	assert(regionID != mark);
+	index = -1;
+	this->mark = mark;
+	regionID = lineMap[xCoord][yCoord];
+	assert(regionID != mark && pix[xCoord][yCoord] == regionID);
 
 	startPoint = Point(xCoord, yCoord);
 
 	unordered_map< int, pair<int, int> > outliers;  // map[xCoord] = (min yCoord, max yCoord)
 	int width = pix.size(), height = pix[0].size();
 
-	queue<Point> q;
-	q.push(Point(xCoord, yCoord));
-
-	while (!q.empty()) {
-		int x = q.front().x;
-		int y = q.front().y;
-		q.pop();
-		if (pix[x][y] == regionID) {
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, false,
+		[&](int x, int y) { return lineMap[x][y] == regionID && pix[x][y] == regionID; },
+		[&](int x, int y1, int y2) {
 			// update component outliers
 			if (outliers.find(x) != outliers.end()) {
-				outliers[x].first = min(outliers[x].first, y);
-				outliers[x].second = max(outliers[x].second, y);
+				outliers[x].first = min(outliers[x].first, y1);
+				outliers[x].second = max(outliers[x].second, y2);
 			}
 			else {
-				outliers[x] = make_pair(y, y);
+				outliers[x] = make_pair(y1, y2);
 			}
-
-			pix[x][y] = mark;
-			if (x > 0)
-				q.push(Point(x-1, y));
-			if (x < width-1)
-				q.push(Point(x+1, y));
-			if (y > 0)
-				q.push(Point(x, y-1));
-			if (y < height-1)
-				q.push(Point(x, y+1));
-		}
-	}
+			std::fill(pix[x].begin() + y1, pix[x].begin() + y2 + 1, mark);
+		});
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
 
 	xl = INT_MAX;
 	xh = INT_MIN;
@@ -147,6 +137,66 @@ ConvexHullComponent::ConvexHullComponent (HandwrittenImage::PIXELS &pix, int xCo
 		Cy /= (6*A);
 		gravityCenter = Point(Cx, Cy);
 	}
+
+	// hull orientation and whether gravity center is strictly inside the hull
+	// getDistance uses binary search over the hull edges only in that case
+	orient = (A > 0) ? 1 : -1;
+	centerInside = (A != 0 && v.size() > 3);
+	for (int i = 0; centerInside && i < (int)v.size()-1; ++i) {
+		if (orient * turnDir(gravityCenter, v[i], v[i+1]) <= 0)
+			centerInside = false;
+	}
+}
+
+ConvexHullComponent::ConvexHullComponent(ByteReader &reader) {
+	size_t n = reader.getUint();
+	if (n > reader.len) {  // every vertex takes at least one byte
+		reader.failed = true;
+		n = 0;
+	}
+	vertices.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		vertices[i].x = reader.getInt();
+		vertices[i].y = reader.getInt();
+	}
+	regionID = reader.getInt();
+	wordID = reader.getInt();
+	index = reader.getInt();
+	mark = reader.getInt();
+	xl = reader.getInt();
+	xh = reader.getInt();
+	yl = reader.getInt();
+	yh = reader.getInt();
+	startPoint.x = reader.getInt();
+	startPoint.y = reader.getInt();
+	gravityCenter.x = reader.getInt();
+	gravityCenter.y = reader.getInt();
+	orient = reader.getInt();
+	centerInside = reader.getUint() != 0;
+	if (vertices.empty())
+		reader.failed = true;
+}
+
+void ConvexHullComponent::save(ByteWriter &writer) const {
+	writer.putUint(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		writer.putInt(vertices[i].x);
+		writer.putInt(vertices[i].y);
+	}
+	writer.putInt(regionID);
+	writer.putInt(wordID);
+	writer.putInt(index);
+	writer.putInt(mark);
+	writer.putInt(xl);
+	writer.putInt(xh);
+	writer.putInt(yl);
+	writer.putInt(yh);
+	writer.putInt(startPoint.x);
+	writer.putInt(startPoint.y);
+	writer.putInt(gravityCenter.x);
+	writer.putInt(gravityCenter.y);
+	writer.putInt(orient);
+	writer.putUint(centerInside ? 1 : 0);
 }
 
 // trun direction of O, A, B
@@ -157,80 +207,105 @@ int ConvexHullComponent::turnDir (const Point &O, const Point &A, const Point &B
 	return (long)(A.x - O.x) * (B.y - O.y) - (long)(A.y - O.y) * (B.x - O.x);
 }
 
+// find the hull edge (vertices[i], vertices[i+1]) that the ray from gravityCenter towards p leaves through
+// vertices are sorted by angle around gravityCenter, so the edge is found by binary search
+// only valid when gravityCenter is strictly inside the hull (centerInside == true)
+int ConvexHullComponent::exitEdge(const Point &p) const {
+	const Point &o = gravityCenter;
+	const Point &r = vertices[0];
+	int n = vertices.size() - 1;
+
+	// half of the turn (measured from r in hull orientation) that a point lies in, 0: [0, 180), 1: [180, 360)
+	long s = orient * ((long)(r.x - o.x) * (p.y - o.y) - (long)(r.y - o.y) * (p.x - o.x));
+	long d = (long)(r.x - o.x) * (p.x - o.x) + (long)(r.y - o.y) * (p.y - o.y);
+	int pHalf = (s > 0 || (s == 0 && d > 0)) ? 0 : 1;
+
+	// last vertex whose angle is not larger than the angle of p
+	int lo = 0, hi = n - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		const Point &v = vertices[mid];
+		long sv = orient * ((long)(r.x - o.x) * (v.y - o.y) - (long)(r.y - o.y) * (v.x - o.x));
+		long dv = (long)(r.x - o.x) * (v.x - o.x) + (long)(r.y - o.y) * (v.y - o.y);
+		int vHalf = (sv > 0 || (sv == 0 && dv > 0)) ? 0 : 1;
+		bool notLarger;
+		if (vHalf != pHalf)
+			notLarger = (vHalf < pHalf);
+		else
+			notLarger = (orient * ((long)(v.x - o.x) * (p.y - o.y) - (long)(v.y - o.y) * (p.x - o.x)) >= 0);
+		if (notLarger)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+// if segment (a, b) intersects with segment (c, d), store the intersection point in (x, y)
+bool ConvexHullComponent::segmentIntersect(const Point &a, const Point &b, const Point &c, const Point &d, int &x, int &y) const {
+	// if a and b are in different sides of segment (c, d)
+	// and c and d are in different sides of segment (a, b)
+	// then segment (a, b) intersects with segment (c, d)
+	if (((long)turnDir(a, b, c) * turnDir(a, b, d) <= 0) &&
+		((long)turnDir(c, d, a) * turnDir(c, d, b) <= 0)) {
+		long m1 = (long)(b.y-a.y)*a.x + (long)(a.x-b.x)*a.y;
+		long m2 = (long)(d.y-c.y)*c.x + (long)(c.x-d.x)*c.y;
+		long D = (long)(b.x-a.x)*(d.y-c.y) - (long)(d.x-c.x)*(b.y-a.y);
+		long D1 = (long)m2*(b.x-a.x) - (long)m1*(d.x-c.x);
+		long D2 = (long)m2*(b.y-a.y) - (long)m1*(d.y-c.y);
+		if (D == 0)  // if D == 0, then (a, b) and (c, d) are parallel
+			return false;
+		x = D1 / D;
+		y = D2 / D;
+		return true;
+	}
+	return false;
+}
+
+// find the point where segment (a, b) crosses the convex hull boundary of this component
+// one end of the segment is the gravity center of this component
+bool ConvexHullComponent::crossHull(const Point &a, const Point &b, int &x, int &y) const {
+	if (centerInside) {
+		// segment leaves a convex hull at most once, only the edge hit by the ray needs to be tested
+		int i = exitEdge(a == gravityCenter ? b : a);
+		return segmentIntersect(a, b, vertices[i], vertices[i+1], x, y);
+	}
+	// degenerated hull, gravity center is on (or outside) the hull boundary
+	for (int i = 0; i < (int)vertices.size()-1; ++i) {
+		if (segmentIntersect(a, b, vertices[i], vertices[i+1], x, y))
+			return true;
+	}
+	return false;
+}
+
 double ConvexHullComponent::getDistance(const ConvexHullComponent *other, int &x1, int &y1, int &x2, int &y2) const {
 	x1 = -1, x2 = -1, y1 = -1, y2 = -1;
+	const Point &a = this->gravityCenter, &b = other->gravityCenter;
 
 	// first, find the convex hull segment of this component that intersects with the (this->gravityCenter, other->gravityCenter) segment
 	if (this->vertices.size() == 2) {  // component only has 1 pixel
-		x1 = this->gravityCenter.x;
-		y1 = this->gravityCenter.y;
+		x1 = a.x;
+		y1 = a.y;
 	}
-	else {
-		for (int i = 0; i < (int)this->vertices.size()-1; ++i) {
-			// if a and b are in different sides of segment (c, d)
-			// and c and d are in different sides of segment (a, b)
-			// then segment (a, b) intersects with segment (c, d)
-			const Point &a = this->gravityCenter, &b = other->gravityCenter;
-			const Point &c = this->vertices[i], &d = this->vertices[i+1];
-			if (((long)turnDir(a, b, c) * turnDir(a, b, d) <= 0) &&
-				((long)turnDir(c, d, a) * turnDir(c, d, b) <= 0)) {
-				long m1 = (long)(b.y-a.y)*a.x + (long)(a.x-b.x)*a.y;
-				long m2 = (long)(d.y-c.y)*c.x + (long)(c.x-d.x)*c.y;
-				long D = (long)(b.x-a.x)*(d.y-c.y) - (long)(d.x-c.x)*(b.y-a.y);
-				long D1 = (long)m2*(b.x-a.x) - (long)m1*(d.x-c.x);
-				long D2 = (long)m2*(b.y-a.y) - (long)m1*(d.y-c.y);
-				if (D == 0)  // if D == 0, then (a, b) and (c, d) are parallel
-					continue;
-				else {
-					x1 = D1 / D;
-					y1 = D2 / D;
-				}
-				break;
-			}
-		}
-	}
-	// one gravityCenter is inside the other components convex hull area
-	if (x1 == -1 && y1 == -1) {
+	else if (!this->crossHull(a, b, x1, y1)) {
+		// one gravityCenter is inside the other components convex hull area
 		return 0.0;
 	}
 
 	// second, find the convex hull segment of other component that intersects with the (this->gravityCenter, other->gravityCenter) segment
 	if (other->vertices.size() == 2) {  // component only has 1 pixel
-		x2 = other->gravityCenter.x;
-		y2 = other->gravityCenter.y;
-	}
-	else {
-		for (int i = 0; i < (int)other->vertices.size()-1; ++i) {
-			// if a and b are in different sides of segment (c, d)
-			// and c and d are in different sides of segment (a, b)
-			// then segment (a, b) intersects with segment (c, d)
-			const Point &a = this->gravityCenter, &b = other->gravityCenter;
-			const Point &c = other->vertices[i], &d = other->vertices[i+1];
-			if (((long)turnDir(a, b, c) * turnDir(a, b, d) <= 0) &&
-				((long)turnDir(c, d, a) * turnDir(c, d, b) <= 0)) {
-				long m1 = (long)(b.y-a.y)*a.x + (long)(a.x-b.x)*a.y;
-				long m2 = (long)(d.y-c.y)*c.x + (long)(c.x-d.x)*c.y;
-				long D = (long)(b.x-a.x)*(d.y-c.y) - (long)(d.x-c.x)*(b.y-a.y);
-				long D1 = (long)m2*(b.x-a.x) - (long)m1*(d.x-c.x);
-				long D2 = (long)m2*(b.y-a.y) - (long)m1*(d.y-c.y);
-				if (D == 0)  // if D == 0, then (a, b) and (c, d) are parallel
-					continue;
-				else {
-					x2 = D1 / D;
-					y2 = D2 / D;
-				}
-				break;
-			}
-		}
+		x2 = b.x;
+		y2 = b.y;
 	}
-	// one gravityCenter is inside the other components convex hull area
-	if (x2 == -1 && y2 == -1) {
+	else if (!other->crossHull(a, b, x2, y2)) {
+		// one gravityCenter is inside the other components convex hull area
 		return 0.0;
 	}
+
 	// segment (this->gravityCenter, other->gravityCenter) cross other convex hull boundary first
 	// distance in this case is 0
-	if (abs(x1 - this->gravityCenter.x) > abs(x2 - this->gravityCenter.x) ||
-		abs(y1 - this->gravityCenter.y) > abs(y2 - this->gravityCenter.y)) {
+	if (abs(x1 - a.x) > abs(x2 - a.x) ||
+		abs(y1 - a.y) > abs(y2 - a.y)) {
 		return 0.0;
 	}
 	return sqrt((double)(x2-x1)*(x2-x1) + (double)(y2-y1)*(y2-y1));
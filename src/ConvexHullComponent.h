@@ -4,19 +4,35 @@
 #include "HandwrittenImage.h"
 #include "Point.h"
 
+class ByteWriter;
+class ByteReader;
+
 class ConvexHullComponent {
 public:
-	ConvexHullComponent(HandwrittenImage::PIXELS &pix, int x, int y, int mark);
+	// the component is the 4-connected pixels of lineMap with the line ID at (x, y), its pixels are marked with mark in pix
+	// pix is only read and written on pixels of the component's line, so components of different lines can be built at the same time
+	ConvexHullComponent(const HandwrittenImage::PIXELS &lineMap, HandwrittenImage::PIXELS &pix, int x, int y, int mark);
+	// a component saved by save, reader.failed is set if the data is malformed
+	ConvexHullComponent(ByteReader &reader);
+	void save(ByteWriter &writer) const;
 	double getDistance(const ConvexHullComponent *other, int&, int &, int&, int&) const;
 
 	vector<Point> vertices;
 	int regionID;
 	int wordID;
+	int index;  // position in HandwrittenImage::allConvexHullComponents
+	int mark;   // value that pixels of this component are marked with
 	int xl, xh, yl, yh;  // bounding box
 	Point startPoint;
 	Point gravityCenter;
 private:
 	int turnDir (const Point &O, const Point &A, const Point &B) const;
+	int exitEdge(const Point &p) const;
+	bool segmentIntersect(const Point &a, const Point &b, const Point &c, const Point &d, int &x, int &y) const;
+	bool crossHull(const Point &a, const Point &b, int &x, int &y) const;
+
+	int orient;         // 1: counter clockwise hull, -1: clockwise hull
+	bool centerInside;  // gravity center is strictly inside the hull
 };
 
 #endif
@@ -1,12 +1,10 @@
 #include <cassert>
 #include <cstdlib>
-#include <queue>
 #include <stack>
 #include "GroupTree.h"
 
 using std::min;
 using std::max;
-using std::queue;
 using std::stack;
 using std::pair;
 using std::make_pair;
@@ -14,92 +12,129 @@ using std::make_pair;
 GroupTreeNode::GroupTreeNode(int st, int ed) {
 	start = st;
 	end = ed;
-	subGroups.clear();
+	firstSubGroup = -1;
+	subGroupCnt = 0;
 }
 
-GroupTreeNode::~GroupTreeNode() {
-	for (size_t i = 0; i < subGroups.size(); ++i)
-		delete subGroups[i];
-	subGroups.clear();
+GroupTree::GroupTree(const vector<double> &g, double t, double a) {
+	gaps = g;
+	threshold = t;
+	alpha = a;
+
+	// build segment tree of gaps, the tree only depends on gaps, so grouping can be redone with other threshold and alpha
+	leafCnt = 1;
+	while (leafCnt < (int)gaps.size())
+		leafCnt *= 2;
+	maxTree.assign(2*leafCnt, -1);
+	for (size_t i = 0; i < gaps.size(); ++i)
+		maxTree[leafCnt+i] = gaps[i];
+	for (int i = leafCnt-1; i > 0; --i)
+		maxTree[i] = max(maxTree[2*i], maxTree[2*i+1]);
+}
+
+// max gap in [l, r], node covers [nl, nr]
+double GroupTree::maxGap(int node, int nl, int nr, int l, int r) const {
+	if (r < nl || nr < l)
+		return -1;
+	if (l <= nl && nr <= r)
+		return maxTree[node];
+	int mid = (nl + nr) / 2;
+	return max(maxGap(2*node, nl, mid, l, r), maxGap(2*node+1, mid+1, nr, l, r));
+}
+
+// last index in [l, r] whose gap > val, -1 if there is no such gap
+int GroupTree::lastGreater(int node, int nl, int nr, int l, int r, double val) const {
+	if (r < nl || nr < l || !(maxTree[node] > val))
+		return -1;
+	if (nl == nr)
+		return nl;
+	int mid = (nl + nr) / 2;
+	int res = lastGreater(2*node+1, mid+1, nr, l, r, val);
+	if (res == -1)
+		res = lastGreater(2*node, nl, mid, l, r, val);
+	return res;
+}
+
+// first index in [l, r] whose gap >= val, -1 if there is no such gap
+int GroupTree::firstNotLess(int node, int nl, int nr, int l, int r, double val) const {
+	if (r < nl || nr < l || maxTree[node] < val)
+		return -1;
+	if (nl == nr)
+		return nl;
+	int mid = (nl + nr) / 2;
+	int res = firstNotLess(2*node, nl, mid, l, r, val);
+	if (res == -1)
+		res = firstNotLess(2*node+1, mid+1, nr, l, r, val);
+	return res;
+}
+
+// index of the gap a group [l-1, r] would be split at
+// gaps are compared as integers: the split is at the last gap that is larger than the integer part of the max gap,
+// or at the first max gap if the max gap is an integer
+int GroupTree::splitIndex(int l, int r) const {
+	int intMaxGap = maxGap(1, 0, leafCnt-1, l, r);
+	int res = lastGreater(1, 0, leafCnt-1, l, r, intMaxGap);
+	if (res == -1)
+		res = firstNotLess(1, 0, leafCnt-1, l, r, intMaxGap);
+	return res;
 }
 
-bool GroupTreeNode::divideGroup (const vector<double> &gaps, double alpha) {
+bool GroupTree::divideGroup(int node) {
+	int start = nodes[node].start, end = nodes[node].end;
 	if (start == end)  // single element group
 		return false;
 	int leftGap = gaps[start];
 	int rightGap = gaps[end+1];
-	int maxGap = -1, maxGapIndex = -1;
-	for (int i = start+1; i <= end; ++i) {
-		if (gaps[i] > maxGap) {
-			maxGap = gaps[i];
-			maxGapIndex = i;
-		}
-	}
+	int maxGapIndex = splitIndex(start+1, end);
+	int maxGap = gaps[maxGapIndex];
 	if (maxGap*alpha > min(leftGap, rightGap)) {
-		// delete old sub groups
-		for (size_t i = 0; i < subGroups.size(); ++i)
-			delete subGroups[i];
-		subGroups.clear();
 		// add new sub groups
-		subGroups.push_back(new GroupTreeNode(start, maxGapIndex-1));
-		subGroups.push_back(new GroupTreeNode(maxGapIndex, end));
+		nodes[node].firstSubGroup = nodes.size();
+		nodes[node].subGroupCnt = 2;
+		nodes.push_back(GroupTreeNode(start, maxGapIndex-1));
+		nodes.push_back(GroupTreeNode(maxGapIndex, end));
 		return true;
 	}
 	return false;
 }
 
-GroupTree::GroupTree(const vector<double> &g, double t, double a) {
-	gaps = g;
-	threshold = t;
-	alpha = a;
-	mainGroup = NULL;
-}
-
-GroupTree::~GroupTree() {
-	delete mainGroup;
-}
-
 void GroupTree::grouping() {
 	assert(gaps.size() > 2);
 
-	mainGroup = new GroupTreeNode(0, gaps.size()-2);
+	// a group tree of n elements has at most 2n-1 nodes, plus the main group
+	nodes.clear();
+	nodes.reserve(2*gaps.size());
+	nodes.push_back(GroupTreeNode(0, gaps.size()-2));
+	nodes[0].firstSubGroup = 1;
 	// if gap larger than threshold, split into subgroups
 	int lastEnd = 0;
 	for (int i = 1; i <= (int)gaps.size()-2; ++i) {
 		if (gaps[i] > threshold) {
-			mainGroup->subGroups.push_back(new GroupTreeNode(lastEnd, i-1));
+			nodes.push_back(GroupTreeNode(lastEnd, i-1));
 			lastEnd = i;
 		}
 	}
-	mainGroup->subGroups.push_back(new GroupTreeNode(lastEnd, gaps.size()-2)); // handle the last subgroup
+	nodes.push_back(GroupTreeNode(lastEnd, gaps.size()-2)); // handle the last subgroup
+	nodes[0].subGroupCnt = nodes.size() - 1;
 
-	// futher split subgroups into sub-subgroups
-	queue<GroupTreeNode *> q;
-	for (size_t i = 0; i < mainGroup->subGroups.size(); ++i)
-		q.push(mainGroup->subGroups[i]);
-	while (!q.empty()) {
-		GroupTreeNode *ptr = q.front();
-		q.pop();
-		if (ptr->divideGroup(gaps, alpha)) {
-			for (size_t i = 0; i < ptr->subGroups.size(); ++i)
-				q.push(ptr->subGroups[i]);
-		}
-	}
+	// futher split subgroups into sub-subgroups, new nodes are appended to the array
+	for (size_t i = 1; i < nodes.size(); ++i)
+		divideGroup(i);
 }
 
 vector< pair<int, int> > GroupTree::getGroupingResult() const {
 	vector< pair<int, int> >res;
-	stack<GroupTreeNode *> st;
-	st.push(mainGroup);
+	stack<int> st;
+	st.push(0);
 	while (!st.empty()) {
-		GroupTreeNode *ptr = st.top();
+		const GroupTreeNode &node = nodes[st.top()];
 		st.pop();
-		if (ptr->subGroups.size() == 0) {  // tree leaf
-			res.push_back(make_pair(ptr->start, ptr->end));
+		if (node.subGroupCnt == 0) {  // tree leaf
+			res.push_back(make_pair(node.start, node.end));
 		}
 		else {
-			for (int i = ptr->subGroups.size()-1; i >= 0; --i)
-				st.push(ptr->subGroups[i]);
+			for (int i = node.subGroupCnt-1; i >= 0; --i)
+				st.push(node.firstSubGroup + i);
 		}
 	}
 	return res;
@@ -7,26 +7,34 @@
 using std::pair;
 using std::vector;
 
+// group tree nodes are stored in a flat array, children of a node are stored contiguously
 struct GroupTreeNode {
 	int start; // group start index
 	int end;   // group end index
-	vector<GroupTreeNode *> subGroups;
+	int firstSubGroup;  // index of the first sub group in GroupTree::nodes, -1 if this node is a leaf
+	int subGroupCnt;    // number of sub groups
 
 	GroupTreeNode(int st, int ed);
-	~GroupTreeNode();
-	bool divideGroup(const vector<double> &gaps, double alpha);
 };
 
 struct GroupTree {
 	GroupTree(const vector<double> &g, double t, double a);
-	~GroupTree();
 	void grouping();
 	vector< pair<int, int> > getGroupingResult() const;
 
-	GroupTreeNode *mainGroup;
+	vector<GroupTreeNode> nodes;  // nodes[0] is the main group
 	vector<double> gaps;
 	double threshold;
 	double alpha;
+private:
+	bool divideGroup(int node);
+	int splitIndex(int l, int r) const;
+	double maxGap(int node, int nl, int nr, int l, int r) const;
+	int lastGreater(int node, int nl, int nr, int l, int r, double val) const;
+	int firstNotLess(int node, int nl, int nr, int l, int r, double val) const;
+
+	vector<double> maxTree;  // segment tree of gaps, answers range max gap queries
+	int leafCnt;
 };
 
 #endif
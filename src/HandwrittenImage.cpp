@@ -1,9 +1,6 @@
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
-#include <queue>
-#include <map>
-#include <array>
 #include <cmath>
 #include <cstdint>
 #include <cassert>
@@ -13,13 +10,16 @@
 #include "Point.h"
 #include "GroupTree.h"
 #include "MsgPrint.h"
+#include "ThreadPool.h"
+#include "ByteStream.h"
+#include "Timeline.h"
+#include "StageProfile.h"
+#include "SpanFill.h"
 
 #define PI 3.14159265
 
-using std::map;
-using std::array;
-using std::queue;
 using std::make_pair;
+using std::pair;
 using std::min;
 using std::max;
 
@@ -27,16 +27,135 @@ HandwrittenImage::HandwrittenImage() {
 	width = -1;
 	height = -1;
 	charH = -1;
+	blurWinW = -1;
+	blurWinH = -1;
+	scdWinH = -1;
+	outputTypes = ALL_OUTPUTS;
+	tileMemoryBudget = 0;
+	cacheDistances = false;
+	threadPool = NULL;
 }
 
 HandwrittenImage::~HandwrittenImage() {
+	clearComponents();
+}
+
+// set pix to a width x height plane filled with val, memory of pix is reused when it is large enough
+void HandwrittenImage::resetPixels(PIXELS &pix, int32_t val) const {
+	pix.resize(width);
+	for (int x = 0; x < width; ++x)
+		pix[x].assign(height, val);
+}
+
+void HandwrittenImage::clearComponents() {
+	for (size_t i = 0; i < allConvexHullComponents.size(); ++i)
+		delete allConvexHullComponents[i];
+	allConvexHullComponents.clear();
+	componentDistances.clear();
+}
+
+// in tiled mode, free a plane once later stages no longer read it, unless one of the requested outputs is drawn from it
+void HandwrittenImage::releasePixels(PIXELS &pix, uint32_t outputs) {
+	if (tiled() && !outputRequested(outputs))
+		PIXELS().swap(pix);
+}
+
+// rows per band so that the band temporaries, bytesPerRow per row and 2*halo extra rows, fit in the tile memory budget
+// beside the given number of whole-page planes
+int HandwrittenImage::bandRows(int64_t bytesPerRow, int halo, int planes) const {
+	int64_t rows = (tileMemoryBudget - planes*planeBytes()) / bytesPerRow - 2*halo;
+	return (int)max<int64_t>(1, min<int64_t>(rows, height));
+}
+
+struct HandwrittenImage::LineBox {
+	int xl, xh, yl, yh;  // bounding box of the pixels of a line
+	LineBox() {
+		xl = INT_MAX;
+		xh = INT_MIN;
+		yl = INT_MAX;
+		yh = INT_MIN;
+	}
+	int64_t area() const {
+		return (xl > xh) ? 0 : (int64_t)(xh-xl+1)*(yh-yl+1);
+	}
+};
+
+// bounding box of every line in lineMap, indexed by line ID, lines without pixels have an empty box
+vector<HandwrittenImage::LineBox> HandwrittenImage::getLineBoxes(const PIXELS &lineMap) const {
+	return parallelReduce< vector<LineBox> >(0, width, vector<LineBox>(1),
+		[&](int xb, int xe) {
+			vector<LineBox> res(1);
+			for (int x = xb; x < xe; ++x) {
+				for (int y = 0; y < height; ++y) {
+					int id = lineMap[x][y];
+					if (id <= 0)
+						continue;
+					if (id >= (int)res.size())
+						res.resize(id+1);
+					LineBox &box = res[id];
+					box.xl = min(box.xl, x);
+					box.xh = max(box.xh, x);
+					box.yl = min(box.yl, y);
+					box.yh = max(box.yh, y);
+				}
+			}
+			return res;
+		},
+		[](const vector<LineBox> &a, const vector<LineBox> &b) {
+			vector<LineBox> res = a;
+			if (b.size() > res.size())
+				res.resize(b.size());
+			for (size_t id = 0; id < b.size(); ++id) {
+				res[id].xl = min(res[id].xl, b[id].xl);
+				res[id].xh = max(res[id].xh, b[id].xh);
+				res[id].yl = min(res[id].yl, b[id].yl);
+				res[id].yh = max(res[id].yh, b[id].yh);
+			}
+			return res;
+		});
+}
 
+// run task(line) for every line with lineCost[line] > 0, lines are independent tasks, costlier lines are started first
+void HandwrittenImage::runLineTasks(const char *name, const vector<int64_t> &lineCost, const function<void(int)> &task) const {
+	vector<int> lines;
+	for (size_t l = 0; l < lineCost.size(); ++l) {
+		if (lineCost[l] > 0)
+			lines.push_back(l);
+	}
+	stable_sort(lines.begin(), lines.end(), [&](int a, int b) { return lineCost[a] > lineCost[b]; });
+	auto lineTask = [&](int line) {
+		Timeline::Span span(name, "line", NULL, line);
+		task(line);
+	};
+	if (threadPool == NULL) {
+		for (size_t i = 0; i < lines.size(); ++i)
+			lineTask(lines[i]);
+	}
+	else
+		threadPool->runTasks(lines.size(), [&](int i) { lineTask(lines[i]); });
+}
+
+// run func(begin, end) on chunks of [first, last), iterations must not depend on each other
+void HandwrittenImage::parallelFor(int first, int last, const function<void(int, int)> &func) const {
+	if (threadPool == NULL)
+		func(first, last);
+	else
+		threadPool->parallelFor(first, last, func);
+}
+
+// reduce chunks of [first, last) with func(begin, end), chunk results are combined from left to right
+template <class T>
+T HandwrittenImage::parallelReduce(int first, int last, const T &init, const function<T(int, int)> &func, const function<T(const T&, const T&)> &combine) const {
+	if (threadPool == NULL)
+		return combine(init, func(first, last));
+	return threadPool->parallelReduce(first, last, init, func, combine);
 }
 
 void HandwrittenImage::readOneBitBMP(const char *fileName) {
 	char msg[1000];
 	sprintf(msg, "Reading image %s ......", fileName);
 	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+	Timeline::Span span("readOneBitBMP", "io");
 
 	FILE *f = fopen(fileName, "rb");
 
@@ -48,8 +167,10 @@ void HandwrittenImage::readOneBitBMP(const char *fileName) {
 	}
 
 	// BMP file has 54 byte header
+	// file is closed before reporting errors, ERR does not always exit the process
 	uint8_t header[54];
 	if (fread(header, 1, 54, f) != 54) {
+		fclose(f);
 		MsgPrint::msgPrint(MsgPrint::ERR, "Cannot read BMP header.");
 	}
 	
@@ -59,23 +180,31 @@ void HandwrittenImage::readOneBitBMP(const char *fileName) {
 	uint16_t bitCnt = *(uint16_t*)&header[28];  // # of bits per pixel
 
 	// verify the file is 1-bit BMP
-	if (sig != 0x4D42 || bitCnt != 1)
+	if (sig != 0x4D42 || bitCnt != 1) {
+		fclose(f);
 		MsgPrint::msgPrint(MsgPrint::ERR, "Image is not 1-bit BMP.\n");
+	}
+	if (width <= 0 || height <= 0) {
+		fclose(f);
+		MsgPrint::msgPrint(MsgPrint::ERR, "Unsupported BMP image size.");
+	}
 
 	// lines are aligned on 4-byte boundary
 	uint32_t lineSize = (width + 31) / 32 * 4;
 	uint32_t dataSize = lineSize * height;
-	uint8_t *data = new uint8_t[dataSize];
-	binPix = PIXELS(width, vector<int32_t>(height, -1));
+	vector<uint8_t> data(dataSize);
+	resetPixels(binPix, -1);
 
 	// color table - 2 X numbers of colors bytes, 8 bytes for 1-bit BMP
 	uint8_t palette[8];
 	if (fread(palette, 1, 8, f) != 8) {
+		fclose(f);
 		MsgPrint::msgPrint(MsgPrint::ERR, "Cannot read BMP color palette.");
 	}
 
 	// read data
-	if (fread(data, 1, dataSize, f) != dataSize) {
+	if (fread(data.data(), 1, dataSize, f) != dataSize) {
+		fclose(f);
 		MsgPrint::msgPrint(MsgPrint::ERR, "Cannot read BMP color data.");
 	}
 
@@ -91,10 +220,61 @@ void HandwrittenImage::readOneBitBMP(const char *fileName) {
 			}
 		}
 	}
-	delete [] data;
 	fclose(f);
 }
 
+void HandwrittenImage::readPixels(const uint8_t *pixels, int width, int height, int stride, bool gray, int grayThreshold) {
+	MsgPrint::msgPrint(MsgPrint::INFO, "Reading image from memory ......");
+	if (pixels == NULL || width <= 0 || height <= 0 || stride < width)
+		MsgPrint::msgPrint(MsgPrint::ERR, "Unsupported image buffer.");
+	this->width = width;
+	this->height = height;
+	resetPixels(binPix, 0);
+	parallelFor(0, width, [&](int xb, int xe) {
+		for (int y = 0; y < height; ++y) {
+			const uint8_t *row = pixels + (size_t)y*stride;
+			for (int x = xb; x < xe; ++x)
+				binPix[x][y] = (gray ? row[x] < grayThreshold : row[x] != 0) ? 1 : 0;
+		}
+	});
+}
+
+// components are sorted by region, each run of one regionID is a region
+int HandwrittenImage::getRegionCount() const {
+	int cnt = 0;
+	for (size_t i = 0; i < allConvexHullComponents.size(); ++i)
+		if (i == 0 || allConvexHullComponents[i]->regionID != allConvexHullComponents[i-1]->regionID)
+			++cnt;
+	return cnt;
+}
+
+int64_t HandwrittenImage::countInkPixels() const {
+	int64_t cnt = 0;
+	for (size_t x = 0; x < binPix.size(); ++x)
+		cnt += std::count(binPix[x].begin(), binPix[x].end(), 1);
+	return cnt;
+}
+
+void HandwrittenImage::getLabels(PIXTYPE type, int32_t *labels) const {
+	if (type != NOSLANT && type != WORDMAP)
+		MsgPrint::msgPrint(MsgPrint::ERR, "Unexpected PIXTYPE to call 'getLabels'");
+	const PIXELS &pix = (type == NOSLANT) ? noSlantTextLineMap : componentMap;
+	if ((int)pix.size() != width)
+		MsgPrint::msgPrint(MsgPrint::ERR, "Label plane is not available");
+	parallelFor(0, height, [&](int yb, int ye) {
+		for (int y = yb; y < ye; ++y) {
+			int32_t *row = labels + (size_t)y*width;
+			for (int x = 0; x < width; ++x) {
+				int v = pix[x][y];
+				if (type == WORDMAP)
+					row[x] = (v < 0) ? componentWordID[-v-1] : 0;
+				else
+					row[x] = max(v, 0);
+			}
+		}
+	});
+}
+
 void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 	char msg[1000];
 	sprintf(msg, "Writing image %s ......", fileName);
@@ -139,7 +319,8 @@ void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 			}
 			color = GRAY;
 			break;
-		case SPACETRACES:
+		case SPACETRACES: {
+			PIXELS spaceTraces = this->spaceTraces.toPlane(height);
 			pix = blurPix;
 			for (int y = 0; y < height; ++y) {
 				for (int x = 0; x < width; ++x) {
@@ -153,6 +334,7 @@ void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 			}
 			color = GRAY;
 			break;
+		}
 		case REGIONS:
 			pix = regionMap;
 			for (int y = 0; y < height; ++y) {
@@ -177,7 +359,8 @@ void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 			}
 			color = GRAY;
 			break;
-		case TEXTTRACES:
+		case TEXTTRACES: {
+			PIXELS textTraces = this->textTraces.toPlane(height);
 			pix = binPixBR;
 			for (int y = 0; y < height; ++y) {
 				for (int x = 0; x < width; ++x) {
@@ -193,6 +376,7 @@ void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 			}
 			color = RGB;
 			break;
+		}
 		case TEXTLINES:
 			pix = textLineMap;
 			color = RGB;
@@ -202,11 +386,37 @@ void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 			color = RGB;
 			break;
 		case CONVEXHULL:
-			pix = convexHullPix;
+			// the convex hulls, their centers of gravity and the gaps between words are drawn over the text lines
+			pix = noSlantTextLineMap;
+			for (size_t k = 0; k < allConvexHullComponents.size(); ++k) {
+				const vector<Point> &v = allConvexHullComponents[k]->vertices;
+				for (size_t i = 0; i < v.size()-1; ++i) {
+					if (v[i] != v[i+1])
+						drawLine(pix, v[i], v[i+1], -1);
+				}
+				const Point &gc = allConvexHullComponents[k]->gravityCenter;
+				for (int x = gc.x-2; x <= gc.x+2; ++x) {
+					for (int y = gc.y-2; y <= gc.y+2; ++y) {
+						if (x >= 0 && x < width && y >=0 && y < height)
+							pix[x][y] = -1;
+					}
+				}
+			}
+			for (size_t i = 0; i < wordGaps.size(); ++i)
+				drawLine(pix, wordGaps[i].first, wordGaps[i].second, 12);
 			color = RGB;
 			break;
 		case WORDMAP:
-			pix = wordMap;
+			// remap component labels to word IDs
+			pix = componentMap;
+			parallelFor(0, width, [&](int xb, int xe) {
+				for (int x = xb; x < xe; ++x) {
+					for (int y = 0; y < height; ++y) {
+						if (pix[x][y] < 0)
+							pix[x][y] = componentWordID[-pix[x][y]-1];
+					}
+				}
+			});
 			color = RGB;
 			break;
 		default:
@@ -220,7 +430,14 @@ void HandwrittenImage::writeBMP(const char *fileName, PIXTYPE type) const {
 }
 
 void HandwrittenImage::writeOneBitBMP(const char *fileName, const PIXELS &pix) const {
+	Timeline::Span span("writeOneBitBMP", "io");
 	char msg[1000];
+	// make sure pix contains value
+	if (pix.size() == 0 || pix[0].size() == 0) {
+		sprintf(msg, "Cannot write to file %s, data is invalid.", fileName);
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+
 	FILE *f = fopen(fileName, "wb");
 
 	// validate file stream
@@ -229,12 +446,6 @@ void HandwrittenImage::writeOneBitBMP(const char *fileName, const PIXELS &pix) c
 		MsgPrint::msgPrint(MsgPrint::ERR, msg);
 	}
 
-	// make sure pix contains value
-	if (pix.size() == 0 || pix[0].size() == 0) {
-		sprintf(msg, "Cannot write to file %s, data is invalid.", fileName);
-		MsgPrint::msgPrint(MsgPrint::ERR, msg);
-	}
-
 	int w = pix.size();
 	int h = pix[0].size();
 
@@ -265,28 +476,36 @@ void HandwrittenImage::writeOneBitBMP(const char *fileName, const PIXELS &pix) c
 	
 	fwrite(header, 1, 54, f);
 	fwrite(palette, 1, 8, f);
-	uint8_t oneByte[1];
+	// rows are assembled in a buffer and written at once
+	vector<uint8_t> row(lineSize);
 	// the bottom most line in image is the first line in BMP
 	for (int j = h-1; j >= 0; --j) {
 		for (int i = 0; i < lineSize; ++i) {
-			oneByte[0] = 0;
+			row[i] = 0;
 			for (int k = 7; k >= 0; --k) {
 				int x = i*8 + 7-k;
 				if (x < w && pix[x][j] == 0) { // white pixel, 1 in BMP
-					oneByte[0] += 1<<k;
+					row[i] += 1<<k;
 				}
 			}
-			fwrite(oneByte, 1, 1, f);
 		}
+		fwrite(&row[0], 1, lineSize, f);
 	}
 	fclose(f);
 }
 
 void HandwrittenImage::write24BitBMP(const char *fileName, const PIXELS &pix, COLOR color) const {
+	Timeline::Span span("write24BitBMP", "io");
 	char msg[1000];
 	if (color != GRAY && color != RGB)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Function 'write24BitBMP' only accept COLOR = GRAY or RGB");
 
+	// make sure pix contains value
+	if (pix.size() == 0 || pix[0].size() == 0) {
+		sprintf(msg, "Cannot write to file %s, data is invalid.", fileName);
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+
 	FILE *f = fopen(fileName, "wb");
 
 	// validate file stream
@@ -295,12 +514,6 @@ void HandwrittenImage::write24BitBMP(const char *fileName, const PIXELS &pix, CO
 		MsgPrint::msgPrint(MsgPrint::ERR, msg);
 	}
 
-	// make sure pix contains value
-	if (pix.size() == 0 || pix[0].size() == 0) {
-		sprintf(msg, "Cannot write to file %s, data is invalid.", fileName);
-		MsgPrint::msgPrint(MsgPrint::ERR, msg);
-	}
-
 	int w = pix.size();
 	int h = pix[0].size();
 
@@ -329,83 +542,216 @@ void HandwrittenImage::write24BitBMP(const char *fileName, const PIXELS &pix, CO
 	fwrite(header, 1, 54, f);
 
 	// color order of 24-bit BMP is Blue Green Red
-	uint8_t bgr[3];
-	if (color == GRAY) {
-		// bottom most line in image is the first line in BMP
-		for (int j = height-1; j >= 0; --j) {
-			for (int i = 0; i < lineSize; i += 3) {
-				int x = i/3;
-				if (x < w) {
-					bgr[0] = pix[x][j];
-					bgr[1] = bgr[0];
-					bgr[2] = bgr[0];
-					fwrite(bgr, 1, 3, f);
-				}
-				else { // padding bits
-					bgr[0] = 0;
-					bgr[1] = 0;
-					bgr[2] = 0;
-					fwrite(bgr, 1, lineSize-w*3, f);
-				}
+	const int colors[12][3] = {
+		{34, 35, 227},
+		{0, 229, 224},
+		{178, 113, 38},
+		{91, 142, 0},
+		{1, 145, 241},
+		{137, 56, 109},
+		{11, 198, 253},
+		{31, 98, 234},
+		{125, 3, 196},
+		{153, 78, 68},
+		{187, 150, 6},
+		{38, 187, 140}
+	};
+
+	// rows are assembled in a buffer and written at once, padding bytes stay 0
+	vector<uint8_t> row(lineSize, 0);
+	// bottom most line in image is the first line in BMP
+	for (int j = h-1; j >= 0; --j) {
+		for (int x = 0; x < w; ++x) {
+			uint8_t *bgr = &row[x*3];
+			if (color == GRAY) {
+				bgr[0] = pix[x][j];
+				bgr[1] = bgr[0];
+				bgr[2] = bgr[0];
 			}
-		}
-	}
-	else {  // color == RGB
-		// color order of 24-bit BMP is Blue Green Red
-		const int colors[12][3] = {
-			{34, 35, 227},
-			{0, 229, 224},
-			{178, 113, 38},
-			{91, 142, 0},
-			{1, 145, 241},
-			{137, 56, 109},
-			{11, 198, 253},
-			{31, 98, 234},
-			{125, 3, 196},
-			{153, 78, 68},
-			{187, 150, 6},
-			{38, 187, 140}
-		};
-
-		// bottom most line in image is the first line in BMP
-		for (int j = h-1; j >= 0; --j) {
-			for (int i = 0; i < lineSize; i += 3) {
-				int x = i/3;
-				if (x < w) {
-					// -1: content black pixel
-					if (pix[x][j] == -1) {
-						bgr[0] = 0;
-						bgr[1] = 0;
-						bgr[2] = 0;
-						fwrite(bgr, 1, 3, f);
-					}
-					// 0: white space
-					else if (pix[x][j] == 0) {
-						bgr[0] = 255;
-						bgr[1] = 255;
-						bgr[2] = 255;
-						fwrite(bgr, 1, 3, f);
-					}
-					else {
-						int index = pix[x][j] % 12;
-						bgr[0] = colors[index][0];
-						bgr[1] = colors[index][1];
-						bgr[2] = colors[index][2];
-						fwrite(bgr, 1, 3, f);
-					}
-				}
-				else { // padding bits
-					bgr[0] = 0;
-					bgr[1] = 0;
-					bgr[2] = 0;
-					fwrite(bgr, 1, lineSize-w*3, f);
-				}
+			// -1: content black pixel
+			else if (pix[x][j] == -1) {
+				bgr[0] = 0;
+				bgr[1] = 0;
+				bgr[2] = 0;
+			}
+			// 0: white space
+			else if (pix[x][j] == 0) {
+				bgr[0] = 255;
+				bgr[1] = 255;
+				bgr[2] = 255;
+			}
+			else {
+				int index = pix[x][j] % 12;
+				bgr[0] = colors[index][0];
+				bgr[1] = colors[index][1];
+				bgr[2] = colors[index][2];
 			}
 		}
+		fwrite(&row[0], 1, lineSize, f);
 	}
 	fclose(f);
 }
 
+static void putPoints(ByteWriter &writer, const vector<Point> &points) {
+	writer.putUint(points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		writer.putInt(points[i].x);
+		writer.putInt(points[i].y);
+	}
+}
+
+static void getPoints(ByteReader &reader, vector<Point> &points) {
+	size_t n = reader.getUint();
+	if (n > reader.len) {
+		reader.failed = true;
+		return;
+	}
+	points.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		points[i].x = reader.getInt();
+		points[i].y = reader.getInt();
+	}
+}
+
+void HandwrittenImage::saveCheckpoint(CHECKPOINT ckpt, ByteWriter &writer) const {
+	writer.putUint(width);
+	writer.putUint(height);
+	switch (ckpt) {
+	case CKPT_BORDER:
+		writer.putPlane(binPixBR);
+		break;
+	case CKPT_CHARH:
+		writer.putInt(charH);
+		break;
+	case CKPT_DERIVATIVES:
+		writer.putInt(blurWinW);
+		writer.putInt(blurWinH);
+		writer.putInt(scdWinH);
+		writer.putPlane(blurPix);
+		writer.putPlane(blurPixFstOrdParDerivY);
+		writer.putPlane(blurPixScdOrdParDerivY);
+		break;
+	case CKPT_REGIONS:
+		putPoints(writer, spaceTracingSeeds);
+		spaceTraces.save(writer);
+		writer.putPlane(regionMap);
+		break;
+	case CKPT_TEXTLINES:
+		// traceText also marks its seeds in spaceTraces
+		putPoints(writer, textTracingSeeds);
+		textTraces.save(writer);
+		writer.putPlane(textLineMap);
+		spaceTraces.save(writer);
+		break;
+	case CKPT_HULLS:
+		writer.putPlane(noSlantTextLineMap);
+		writer.putPlane(componentMap);
+		writer.putUint(allConvexHullComponents.size());
+		for (size_t i = 0; i < allConvexHullComponents.size(); ++i)
+			allConvexHullComponents[i]->save(writer);
+		break;
+	default:
+		break;
+	}
+}
+
+bool HandwrittenImage::loadCheckpoint(CHECKPOINT ckpt, ByteReader &reader) {
+	if (reader.getUint() != (uint64_t)width || reader.getUint() != (uint64_t)height)
+		return false;
+
+	// everything is decoded into temporaries first, the state is only replaced once the whole checkpoint is read
+	PIXELS planes[3];
+	vector<PIXELS *> targets;
+	auto getPlane = [&](PIXELS &target) {
+		reader.getPlane(planes[targets.size()], width, height);
+		targets.push_back(&target);
+	};
+	int values[3] = {0, 0, 0};
+	vector<Point> seeds;
+	TraceMap traces[2];
+	vector<ConvexHullComponent *> components;
+	switch (ckpt) {
+	case CKPT_BORDER:
+		getPlane(binPixBR);
+		break;
+	case CKPT_CHARH:
+		values[0] = reader.getInt();
+		break;
+	case CKPT_DERIVATIVES:
+		for (int i = 0; i < 3; ++i)
+			values[i] = reader.getInt();
+		getPlane(blurPix);
+		getPlane(blurPixFstOrdParDerivY);
+		getPlane(blurPixScdOrdParDerivY);
+		break;
+	case CKPT_REGIONS:
+		getPoints(reader, seeds);
+		reader.failed = reader.failed || !traces[0].load(reader, width, height);
+		getPlane(regionMap);
+		break;
+	case CKPT_TEXTLINES:
+		getPoints(reader, seeds);
+		reader.failed = reader.failed || !traces[0].load(reader, width, height);
+		getPlane(textLineMap);
+		reader.failed = reader.failed || !traces[1].load(reader, width, height);
+		break;
+	case CKPT_HULLS: {
+		getPlane(noSlantTextLineMap);
+		getPlane(componentMap);
+		size_t n = reader.getUint();
+		for (size_t i = 0; i < n && !reader.failed; ++i)
+			components.push_back(new ConvexHullComponent(reader));
+		break;
+	}
+	default:
+		return false;
+	}
+	if (reader.failed || !reader.atEnd()) {
+		for (size_t i = 0; i < components.size(); ++i)
+			delete components[i];
+		return false;
+	}
+
+	for (size_t i = 0; i < targets.size(); ++i)
+		targets[i]->swap(planes[i]);
+	// planes the stages release in tiled mode are released here as well
+	switch (ckpt) {
+	case CKPT_BORDER:
+		releasePixels(binPix, outputBit(BINPIX));
+		break;
+	case CKPT_CHARH:
+		charH = values[0];
+		releasePixels(scratchPix, 0);
+		break;
+	case CKPT_DERIVATIVES:
+		blurWinW = values[0];
+		blurWinH = values[1];
+		scdWinH = values[2];
+		break;
+	case CKPT_REGIONS:
+		spaceTracingSeeds.swap(seeds);
+		spaceTraces.swap(traces[0]);
+		break;
+	case CKPT_TEXTLINES:
+		textTracingSeeds.swap(seeds);
+		textTraces.swap(traces[0]);
+		spaceTraces.swap(traces[1]);
+		releasePixels(blurPixFstOrdParDerivY, 0);
+		releasePixels(regionMap, outputBit(REGIONS));
+		releasePixels(binPixBR, outputBit(BINPIXBR) | outputBit(CHARH) | outputBit(REGIONS) | outputBit(TEXTTRACES));
+		break;
+	case CKPT_HULLS:
+		clearComponents();
+		allConvexHullComponents.swap(components);
+		releasePixels(scratchPix, 0);
+		releasePixels(textLineMap, outputBit(TEXTLINES));
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
 // each segments is represented as a (start, end) pair
 struct segment {
 	int st; // start point of the segment
@@ -425,123 +771,144 @@ struct segment {
 // then this pixel is a border pixel
 void HandwrittenImage::removeBorder(double hWeight, double vWeight, double threshold) {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Removing Border ......");
+	if (tiled()) {
+		// the border is removed in place, binPix is only copied for its output
+		if (outputRequested(outputBit(BINPIX)))
+			binPixBR = binPix;
+		else
+			binPixBR.swap(binPix);
+		releasePixels(binPix, outputBit(BINPIX));
+		removeBorderTiled(hWeight, vWeight, threshold);
+		return;
+	}
 	this->binPixBR = binPix;
-	vector< vector<segment> > hSeg, vSeg;
-	vector<segment> allSeg;
+	vector< vector<segment> > hSeg(height), vSeg(width);
 
 	// merge horizontal segments
-	for (int y = 0; y < height; ++y) {
-		int st = 0;
-		allSeg.clear(); // segments of a row
-		for (int x = 1; x < width; ++x) {
-			if (binPix[x-1][y] != binPix[x][y]) {
-				allSeg.push_back(segment(st, x-1, binPix[x-1][y]));
-				st = x;
+	parallelFor(0, height, [&](int yb, int ye) {
+		for (int y = yb; y < ye; ++y) {
+			int st = 0;
+			vector<segment> &allSeg = hSeg[y]; // segments of a row
+			for (int x = 1; x < width; ++x) {
+				if (binPix[x-1][y] != binPix[x][y]) {
+					allSeg.push_back(segment(st, x-1, binPix[x-1][y]));
+					st = x;
+				}
 			}
+			allSeg.push_back(segment(st, width-1, binPix[width-1][y])); // handle last black pixel row in each row
 		}
-		allSeg.push_back(segment(st, width-1, binPix[width-1][y])); // handle last black pixel row in each row
-		hSeg.push_back(allSeg);
-	}
+	});
 
 	// merge vertical segments
-	for (int x = 0; x < width; ++x) {
-		int st = 0;
-		allSeg.clear(); // segments of a row
-		for (int y = 1; y < height; ++y) {
-			if (binPix[x][y-1] != binPix[x][y]) {
-				allSeg.push_back(segment(st, y-1, binPix[x][y-1]));
-				st = y;
+	parallelFor(0, width, [&](int xb, int xe) {
+		for (int x = xb; x < xe; ++x) {
+			int st = 0;
+			vector<segment> &allSeg = vSeg[x]; // segments of a column
+			for (int y = 1; y < height; ++y) {
+				if (binPix[x][y-1] != binPix[x][y]) {
+					allSeg.push_back(segment(st, y-1, binPix[x][y-1]));
+					st = y;
+				}
 			}
+			allSeg.push_back(segment(st, height-1, binPix[x][height-1])); // handle last black pixel row in each row
 		}
-		allSeg.push_back(segment(st, height-1, binPix[x][height-1])); // handle last black pixel row in each row
-		vSeg.push_back(allSeg);
-	}
+	});
 
 	// remove border
 	// store the sum of hSegment and vSegment length that run through each pixel
-	PIXELS segLenMap = PIXELS(width, vector<int32_t>(height, 0)); 
-
-	for (int y = 0; y < height; ++y) {
-		for (size_t s = 0; s < hSeg[y].size(); ++s) {
-			if (hSeg[y][s].type == 1) {
-				for (int i = hSeg[y][s].st; i <= hSeg[y][s].ed; ++i)
-					segLenMap[i][y] = hWeight * hSeg[y][s].len();
+	PIXELS &segLenMap = scratchPix;
+	resetPixels(segLenMap, 0);
+
+	parallelFor(0, height, [&](int yb, int ye) {
+		for (int y = yb; y < ye; ++y) {
+			for (size_t s = 0; s < hSeg[y].size(); ++s) {
+				if (hSeg[y][s].type == 1) {
+					for (int i = hSeg[y][s].st; i <= hSeg[y][s].ed; ++i)
+						segLenMap[i][y] = hWeight * hSeg[y][s].len();
+				}
 			}
 		}
-	}
-	for (int x = 0; x < width; ++x) {
-		for (size_t s = 0; s < vSeg[x].size(); ++s) {
-			if (vSeg[x][s].type == 1) {
-				for (int i = vSeg[x][s].st; i <= vSeg[x][s].ed; ++i)
-					segLenMap[x][i] += vWeight * vSeg[x][s].len();
+	});
+	parallelFor(0, width, [&](int xb, int xe) {
+		for (int x = xb; x < xe; ++x) {
+			for (size_t s = 0; s < vSeg[x].size(); ++s) {
+				if (vSeg[x][s].type == 1) {
+					for (int i = vSeg[x][s].st; i <= vSeg[x][s].ed; ++i)
+						segLenMap[x][i] += vWeight * vSeg[x][s].len();
+				}
+			}
+			for (int y = 0; y < height; ++y) {
+				if (segLenMap[x][y] > threshold*height) {
+					binPixBR[x][y] = 0;
+				}
 			}
 		}
-	}
+	});
+}
 
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			if (segLenMap[x][y] > threshold*height) {
-				binPixBR[x][y] = 0;
+// same result as the whole-page pass, but only a band of horizontal segment lengths is kept at a time
+// the black vertical segment through the current row of each column is carried from band to band
+// binPixBR is updated in place, a band is done before the next is read and a column only reads its rows below the band
+void HandwrittenImage::removeBorderTiled(double hWeight, double vWeight, double threshold) {
+	char msg[1000];
+	int64_t floorMB = (TILED_PAGE_PLANES*planeBytes() + (1 << 20) - 1) >> 20;
+	if (tileMemoryBudget < floorMB << 20) {
+		sprintf(msg, "tile_memory_budget is below the %lld MB of whole-page planes this page needs, its peak memory will exceed the budget", (long long)floorMB);
+		MsgPrint::msgPrint(MsgPrint::WARN, msg);
+	}
+	int rows = bandRows((int64_t)width*sizeof(int32_t), 0, 1);
+	sprintf(msg, "Tiled mode: %d rows per band ......", rows);
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+	PIXELS hLen(width, vector<int32_t>(rows));  // weighted black horizontal segment length through each pixel of the band
+	vector<int> vSt(width, 0), vEd(width, -1);  // start and end of the last black vertical segment of each column
+
+	for (int y0 = 0; y0 < height; y0 += rows) {
+		int y1 = min(y0+rows, height);
+		parallelFor(y0, y1, [&](int yb, int ye) {
+			for (int y = yb; y < ye; ++y) {
+				int st = 0;
+				for (int x = 1; x <= width; ++x) {
+					if (x == width || binPixBR[x-1][y] != binPixBR[x][y]) {
+						int32_t len = (binPixBR[x-1][y] == 1) ? (int32_t)(hWeight * (x-st)) : 0;
+						for (int i = st; i < x; ++i)
+							hLen[i][y-y0] = len;
+						st = x;
+					}
+				}
 			}
-		}
+		});
+		parallelFor(0, width, [&](int xb, int xe) {
+			for (int x = xb; x < xe; ++x) {
+				for (int y = y0; y < y1; ++y) {
+					if (binPixBR[x][y] != 1)
+						continue;
+					// a new black vertical segment starts here, follow it down
+					if (y > vEd[x]) {
+						vSt[x] = y;
+						for (vEd[x] = y; vEd[x]+1 < height && binPixBR[x][vEd[x]+1] == 1; ++vEd[x]);
+					}
+					int32_t segLen = hLen[x][y-y0];
+					segLen += vWeight * (vEd[x]-vSt[x]+1);
+					if (segLen > threshold*height)
+						binPixBR[x][y] = 0;
+				}
+			}
+		});
 	}
 }
 
-// do BFS, color a connected component at (xCoord, yCoord) in pix from val1 to val2
+// flood fill, color a connected component at (xCoord, yCoord) in pix from val1 to val2
 void HandwrittenImage::colorComponent(HandwrittenImage::PIXELS &pix, int xCoord, int yCoord, int val1, int val2, CONNMODE mode) {
 	if (pix[xCoord][yCoord] != val1) {
 		printf ("%d, %d\n", val1, pix[xCoord][yCoord]);
 		MsgPrint::msgPrint(MsgPrint::ERR, "Wrong input arguments to call 'colorComponent'");
 	}
-	queue<Point> q;
-	q.push(Point(xCoord, yCoord));
-
-	if (mode == NEIGHBOR4) {
-		while (!q.empty()) {
-			int x = q.front().x;
-			int y = q.front().y;
-			q.pop();
-			if (pix[x][y] == val1) {
-				pix[x][y] = val2;
-				if (x > 0)
-					q.push(Point(x-1, y));
-				if (x < width-1)
-					q.push(Point(x+1, y));
-				if (y > 0)
-					q.push(Point(x, y-1));
-				if (y < height-1)
-					q.push(Point(x, y+1));
-			}
-		}
-	}
-	else if (mode == NEIGHBOR8) {
-		while (!q.empty()) {
-			int x = q.front().x;
-			int y = q.front().y;
-			q.pop();
-			if (pix[x][y] == val1) {
-				pix[x][y] = val2;
-				if (x > 0)
-					q.push(Point(x-1, y));
-				if (x < width-1)
-					q.push(Point(x+1, y));
-				if (y > 0)
-					q.push(Point(x, y-1));
-				if (y < height-1)
-					q.push(Point(x, y+1));
-				if (x > 0 && y > 0)
-					q.push(Point(x-1, y-1));
-				if (x < width-1 && y > 0)
-					q.push(Point(x+1, y-1));
-				if (x > 0 && y < height-1)
-					q.push(Point(x-1, y+1));
-				if (x < width-1 && y < height-1)
-					q.push(Point(x+1, y+1));
-			}
-		}
-	}
-	else
+	if (mode != NEIGHBOR4 && mode != NEIGHBOR8)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Unexpected CONNMODE to call 'colorComponent'");
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, mode == NEIGHBOR8,
+		[&](int x, int y) { return pix[x][y] == val1; },
+		[&](int x, int y1, int y2) { std::fill(pix[x].begin() + y1, pix[x].begin() + y2 + 1, val2); });
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
 }
 
 struct HandwrittenImage::ComponentInfo {
@@ -555,63 +922,45 @@ struct HandwrittenImage::ComponentInfo {
 	}
 };
 
-// do BFS, get MsgPrint::INFOrmation of a connected component at (xCoord, yCoord) in pix from val1 to val2
+// flood fill, get MsgPrint::INFOrmation of a connected component at (xCoord, yCoord) in pix from val1 to val2
 HandwrittenImage::ComponentInfo HandwrittenImage::getComponentInfo(HandwrittenImage::PIXELS &pix, int xCoord, int yCoord, int val1, int val2) {
 	if (pix[xCoord][yCoord] != val1)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Wrong input arguments to call 'getComponentInfo'");
 	ComponentInfo res;
-	queue<Point> q;
-	q.push(Point(xCoord, yCoord));
-	while (!q.empty()) {
-		int x = q.front().x;
-		int y = q.front().y;
-		q.pop();
-		
-		if (pix[x][y] == val1) {
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, false,
+		[&](int x, int y) { return pix[x][y] == val1; },
+		[&](int x, int y1, int y2) {
 			// update res
-			res.area += 1;
+			res.area += y2 - y1 + 1;
 			res.xl = min(res.xl, x);
 			res.xh = max(res.xh, x);
-			res.yl = min(res.yl, y);
-			res.yh = max(res.yh, y);
-
-			pix[x][y] = val2;
-			if (x > 0)
-				q.push(Point(x-1, y));
-			if (x < width-1)
-				q.push(Point(x+1, y));
-			if (y > 0)
-				q.push(Point(x, y-1));
-			if (y < height-1)
-				q.push(Point(x, y+1));
-		}
-	}
+			res.yl = min(res.yl, y1);
+			res.yh = max(res.yh, y2);
+			std::fill(pix[x].begin() + y1, pix[x].begin() + y2 + 1, val2);
+		});
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
 	return res;
 }
 
-// do BFS, color a connected region at (xCoord, yCoord) in pix from val1 to val2
+// flood fill, color a connected region at (xCoord, yCoord) in pix from val1 to val2
 // similar function as colorComponent
 void HandwrittenImage::colorRegion(HandwrittenImage::PIXELS &pix, int xCoord, int yCoord, int val1, int val2) {
 	if (pix[xCoord][yCoord] != val1)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Wrong input arguments to call 'colorRegion'");
-	queue<Point> q;
-	q.push(Point(xCoord, yCoord));
-	while (!q.empty()) {
-		int x = q.front().x;
-		int y = q.front().y;
-		q.pop();
-		if (pix[x][y] == val1) {
-			pix[x][y] = val2;
-			if (x > 0)
-				q.push(Point(x-1, y));
-			if (x < width-1)
-				q.push(Point(x+1, y));
-			if (y > 0)
-				q.push(Point(x, y-1));
-			if (y < height-1)
-				q.push(Point(x, y+1));
-		}
-	}
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, false,
+		[&](int x, int y) { return pix[x][y] == val1; },
+		[&](int x, int y1, int y2) { std::fill(pix[x].begin() + y1, pix[x].begin() + y2 + 1, val2); });
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
+}
+
+// flood fill, mark the 8-connected component of lineMap at (xCoord, yCoord) with val in visited
+// visited is only read and written on pixels of the component's line, so different lines can be marked at the same time
+void HandwrittenImage::markLineComponent(const PIXELS &lineMap, PIXELS &visited, int xCoord, int yCoord, int val) const {
+	int lineID = lineMap[xCoord][yCoord];
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, true,
+		[&](int x, int y) { return lineMap[x][y] == lineID && visited[x][y] == lineID; },
+		[&](int x, int y1, int y2) { std::fill(visited[x].begin() + y1, visited[x].begin() + y2 + 1, val); });
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
 }
 
 struct HandwrittenImage::RegionInfo {
@@ -626,45 +975,34 @@ struct HandwrittenImage::RegionInfo {
 	}
 };
 
-// do BFS, get MsgPrint::INFOrmation of a Region at (xCoord, yCoord) in pix from val1 to val2
+// flood fill, get MsgPrint::INFOrmation of a Region at (xCoord, yCoord) in pix from val1 to val2
 HandwrittenImage::RegionInfo HandwrittenImage::getRegionInfo(HandwrittenImage::PIXELS &pix, int xCoord, int yCoord, int val1, int val2) {
 	if (pix[xCoord][yCoord] != val1)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Wrong input arguments to call 'getRegionInfo'");
 	RegionInfo res;
-	queue<Point> q;
-	q.push(Point(xCoord, yCoord));
-	while (!q.empty()) {
-		int x = q.front().x;
-		int y = q.front().y;
-		q.pop();
-		
-		if (pix[x][y] == val1) {
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, false,
+		[&](int x, int y) { return pix[x][y] == val1; },
+		[&](int x, int y1, int y2) {
 			// update res
-			res.area += 1;
+			res.area += y2 - y1 + 1;
 			res.xl = min(res.xl, x);
 			res.xh = max(res.xh, x);
-			res.yl = min(res.yl, y);
-			res.yh = max(res.yh, y);
-			if (binPixBR[x][y] == 1)
-				res.blackPixCnt += 1;
-
-			pix[x][y] = val2;
-			if (x > 0)
-				q.push(Point(x-1, y));
-			if (x < width-1)
-				q.push(Point(x+1, y));
-			if (y > 0)
-				q.push(Point(x, y-1));
-			if (y < height-1)
-				q.push(Point(x, y+1));
-		}
-	}
+			res.yl = min(res.yl, y1);
+			res.yh = max(res.yh, y2);
+			for (int y = y1; y <= y2; ++y) {
+				if (binPixBR[x][y] == 1)
+					res.blackPixCnt += 1;
+				pix[x][y] = val2;
+			}
+		});
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
 	return res;
 }
 
 void HandwrittenImage::calcCharHeight(double diffPct, double cutoffFactor) {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Calculating average charactor height ......");
-	PIXELS tmpBinPix = binPixBR;
+	PIXELS &tmpBinPix = scratchPix;
+	tmpBinPix = binPixBR;
 	// List of height, width of the component bounding box, and area (# of black pixels) of the component
 	vector<int> hList, wList, aList;
 	vector<bool> isValid;  // component is considered for charH calculation
@@ -683,6 +1021,7 @@ void HandwrittenImage::calcCharHeight(double diffPct, double cutoffFactor) {
 			}
 		}
 	}
+	releasePixels(scratchPix, 0);
 
 	// get weighted average charactor height, use area as weight
 	int lastWAvgCharH = height;
@@ -695,6 +1034,9 @@ void HandwrittenImage::calcCharHeight(double diffPct, double cutoffFactor) {
 				totArea += aList[i];
 			}
 		}
+		// no components, or none left below the cutoff: a blank page would never converge
+		if (totArea == 0)
+			MsgPrint::msgPrint(MsgPrint::ERR, "No text components to calculate charactor height");
 		wAvgCharH /= totArea;
 		
 		// if diff is smaller than diffPct, stop iteration
@@ -720,43 +1062,94 @@ void HandwrittenImage::blur(int blurW, int blurH) {
 	if (blurW >= width)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Too big window width for image blurring ......");
 
-	blurPix = binPixBR;
+	blurWinW = blurW;
+	blurWinH = blurH;
+	// in tiled mode the blurred plane is only kept for outputs, otherwise it is blurred band by band together with its derivative
+	if (tiled() && !outputRequested(BLUR_OUTPUTS)) {
+		releasePixels(blurPix, 0);
+		return;
+	}
+	resetPixels(blurPix, 0);
+	blurRows(0, height, blurPix, 0);
+}
 
-	for (int y = 0; y < height; ++y) {
-		int yl = max(y-blurH/2, 0);
-		int yh = min(y+blurH/2, height-1);
-		int sum = 0;
-		for (int x = 0; x < width; ++x) {
-			int xll = x-blurW/2;
-			int xhh = x+blurW/2;
-			int xl = max(xll, 0);
-			int xh = min(xhh, width-1);
-			// initialize sum of blur area
-			if (x == 0) {
-				sum = 0;
-				for (int i = xl; i <= xh; ++i) {
-					for (int j = yl; j <= yh; ++j) {
-						sum += binPixBR[i][j];
+// blur rows [yb, ye) of binPixBR into dst[x][y-dstY0]
+void HandwrittenImage::blurRows(int yb, int ye, PIXELS &dst, int dstY0) const {
+	// rows are blurred independently
+	parallelFor(yb, ye, [&](int rb, int re) {
+		for (int y = rb; y < re; ++y) {
+			int yl = max(y-blurWinH/2, 0);
+			int yh = min(y+blurWinH/2, height-1);
+			int sum = 0;
+			for (int x = 0; x < width; ++x) {
+				int xll = x-blurWinW/2;
+				int xhh = x+blurWinW/2;
+				int xl = max(xll, 0);
+				int xh = min(xhh, width-1);
+				// initialize sum of blur area
+				if (x == 0) {
+					sum = 0;
+					for (int i = xl; i <= xh; ++i) {
+						for (int j = yl; j <= yh; ++j) {
+							sum += binPixBR[i][j];
+						}
 					}
 				}
+				// don't need to recalculate the whole blur area at each move
+				// just need to subtract one column, and/or add one column
+				else if (xll <= 0 && xhh < width) {
+					for (int i = yl; i <= yh; ++i)
+						sum += binPixBR[xh][i];
+				}
+				else if (xll > 0 && xhh < width) {
+					for (int i = yl; i <= yh; ++i)
+						sum += (binPixBR[xh][i] - binPixBR[xl-1][i]);
+				}
+				else if (xll > 0 && xhh >= width) {
+					for (int i = yl; i <= yh; ++i)
+						sum -= binPixBR[xl-1][i];
+				}
+				dst[x][y-dstY0] = 255 - 255*sum/(xh-xl+1)/(yh-yl+1);
 			}
-			// don't need to recalculate the whole blur area at each move
-			// just need to subtract one column, and/or add one column
-			else if (xll <= 0 && xhh < width) {
-				for (int i = yl; i <= yh; ++i)
-					sum += binPixBR[xh][i];
-			}
-			else if (xll > 0 && xhh < width) {
-				for (int i = yl; i <= yh; ++i)
-					sum += (binPixBR[xh][i] - binPixBR[xl-1][i]);
-			}
-			else if (xll > 0 && xhh >= width) {
-				for (int i = yl; i <= yh; ++i)
-					sum -= binPixBR[xl-1][i];
+		}
+	});
+}
+
+// partial derivative of Y on rows [yb, ye): mean of src over [y, y+ofs] - mean of src over [y-ofs, y], windows are clipped by the image
+// src[x] holds rows from srcY0, which must cover [yb-ofs, ye+ofs) within the image, results are stored to dst[x][y-dstY0]
+void HandwrittenImage::partialDerivY(const PIXELS &src, int srcY0, PIXELS &dst, int dstY0, int yb, int ye, int ofs) const {
+	// columns are independent
+	parallelFor(0, width, [&](int xb, int xe) {
+		for (int x = xb; x < xe; ++x) {
+			const vector<int32_t> &s = src[x];
+			int suml = 0;
+			int sumh = 0;
+			for (int y = yb; y < ye; ++y) {
+				int yl = max(y-ofs, 0);
+				int yh = min(y+ofs, height-1);
+
+				// don't recalculate suml & sumh at each move
+				// only need to add/subtract several numbers to update suml & sumh
+				if (y == yb) {
+					suml = 0;
+					sumh = 0;
+					for (int i = yl; i <= y; ++i)
+						suml += s[i-srcY0];
+					for (int i = y; i <= yh; ++i)
+						sumh += s[i-srcY0];
+				}
+				else {
+					suml += s[y-srcY0];
+					if (y-ofs-1 >= 0)
+						suml -= s[y-ofs-1-srcY0];
+					sumh -= s[y-1-srcY0];
+					if (y+ofs < height)
+						sumh += s[y+ofs-srcY0];
+				}
+				dst[x][y-dstY0] = sumh/(yh-y+1) - suml/(y-yl+1);
 			}
-			blurPix[x][y] = 255 - 255*sum/(xh-xl+1)/(yh-yl+1);
 		}
-	}
+	});
 }
 
 void HandwrittenImage::initBlurPixFstOrdParDerivY (int winH) {
@@ -765,41 +1158,24 @@ void HandwrittenImage::initBlurPixFstOrdParDerivY (int winH) {
 		MsgPrint::msgPrint(MsgPrint::ERR, "Too big window height for first-order partial derivative calculation ......");
 
 	int ofs = winH/2;
-	blurPixFstOrdParDerivY = PIXELS(width, vector<int>(height, 0));
+	resetPixels(blurPixFstOrdParDerivY, 0);
+	if (!blurPix.empty()) {
+		partialDerivY(blurPix, 0, blurPixFstOrdParDerivY, 0, 0, height, ofs);
+		return;
+	}
 
-	for (int x = 0; x < width; ++x) {
-		int suml = 0;
-		int sumh = 0;
-		for (int y = 0; y < height; ++y) {
-			int yll = y - ofs;
-			int yhh = y + ofs;
-			int yl = max(yll, 0);
-			int yh = min(yhh, height-1);
-
-			// don't recalculate suml & sumh at each move
-			// only need to add/subtract several numbers to update suml & sumh
-			if (y == 0) {
-				suml = 0;
-				sumh = 0;
-				for (int i = yl; i <= y; ++i)
-					suml += blurPix[x][i];
-				for (int i = y; i <= yh; ++i)
-					sumh += blurPix[x][i];
-			}
-			else if (yll <= 0 && yhh < height) {
-				suml += blurPix[x][y];
-				sumh += (blurPix[x][yh] - blurPix[x][y-1]);
-			}
-			else if (yll > 0 && yhh < height) {
-				suml += (blurPix[x][y] - blurPix[x][yl-1]);
-				sumh += (blurPix[x][yh] - blurPix[x][y-1]);
-			}
-			else if (yll > 0 && yhh >= height) {
-				suml += (blurPix[x][y] - blurPix[x][yl-1]);
-				sumh -= blurPix[x][y-1];
-			}
-			blurPixFstOrdParDerivY[x][y] = sumh/(yh-y+1) - suml/(y-yl+1);
-		}
+	// blurring was deferred (tiled mode), blur each band plus ofs rows above and below, then derive the band from it
+	// binPixBR and blurPixFstOrdParDerivY are whole-page planes
+	int rows = bandRows((int64_t)width*sizeof(int32_t), ofs, 2);
+	PIXELS blurBand(width);
+	for (int y0 = 0; y0 < height; y0 += rows) {
+		int y1 = min(y0+rows, height);
+		int bandSt = max(y0-ofs, 0);
+		int bandEd = min(y1+ofs, height);
+		for (int x = 0; x < width; ++x)
+			blurBand[x].resize(bandEd-bandSt);
+		blurRows(bandSt, bandEd, blurBand, bandSt);
+		partialDerivY(blurBand, bandSt, blurPixFstOrdParDerivY, 0, y0, y1, ofs);
 	}
 }
 
@@ -808,138 +1184,141 @@ void HandwrittenImage::initBlurPixScdOrdParDerivY (int winH) {
 	if (winH >= height)
 		MsgPrint::msgPrint(MsgPrint::ERR, "Too big window height for second-order partial derivative calculation ......");
 
-	int ofs = winH/2;
-	blurPixScdOrdParDerivY = PIXELS(width, vector<int>(height, 0));
-
-	for (int x = 0; x < width; ++x) {
-		int suml = 0;
-		int sumh = 0;
-		for (int y = 0; y < height; ++y) {
-			int yll = y - ofs;
-			int yhh = y + ofs;
-			int yl = max(yll, 0);
-			int yh = min(yhh, height-1);
-
-			// don't recalculate suml & sumh at each move
-			// only need to add/subtract several numbers to update suml & sumh
-			if (y == 0) {
-				suml = 0;
-				sumh = 0;
-				for (int i = yl; i <= y; ++i)
-					suml += blurPixFstOrdParDerivY[x][i];
-				for (int i = y; i <= yh; ++i)
-					sumh += blurPixFstOrdParDerivY[x][i];
-			}
-			else if (yll <= 0 && yhh < height) {
-				suml += blurPixFstOrdParDerivY[x][y];
-				sumh += (blurPixFstOrdParDerivY[x][yh] - blurPixFstOrdParDerivY[x][y-1]);
-			}
-			else if (yll > 0 && yhh < height) {
-				suml += (blurPixFstOrdParDerivY[x][y] - blurPixFstOrdParDerivY[x][yl-1]);
-				sumh += (blurPixFstOrdParDerivY[x][yh] - blurPixFstOrdParDerivY[x][y-1]);
-			}
-			else if (yll > 0 && yhh >= height) {
-				suml += (blurPixFstOrdParDerivY[x][y] - blurPixFstOrdParDerivY[x][yl-1]);
-				sumh -= blurPixFstOrdParDerivY[x][y-1];
-			}
-			blurPixScdOrdParDerivY[x][y] = sumh/(yh-y+1) - suml/(y-yl+1);
-		}
+	scdWinH = winH;
+	// only read at the seeds, in tiled mode it is computed there instead of being stored for the whole page
+	if (tiled()) {
+		releasePixels(blurPixScdOrdParDerivY, 0);
+		return;
 	}
+	resetPixels(blurPixScdOrdParDerivY, 0);
+	partialDerivY(blurPixFstOrdParDerivY, 0, blurPixScdOrdParDerivY, 0, 0, height, winH/2);
+}
+
+// second-order partial derivative of Y at (x, y), taken from the stored plane or computed from the first-order one
+int HandwrittenImage::scdOrdParDerivY(int x, int y) const {
+	if (!blurPixScdOrdParDerivY.empty())
+		return blurPixScdOrdParDerivY[x][y];
+
+	int ofs = scdWinH/2;
+	int yl = max(y-ofs, 0);
+	int yh = min(y+ofs, height-1);
+	const vector<int32_t> &fst = blurPixFstOrdParDerivY[x];
+	int suml = 0;
+	int sumh = 0;
+	for (int i = yl; i <= y; ++i)
+		suml += fst[i];
+	for (int i = y; i <= yh; ++i)
+		sumh += fst[i];
+	return sumh/(yh-y+1) - suml/(y-yl+1);
 }
 
 // hSeedDist, vSeedDist: distance between adjacent seedss
 void HandwrittenImage::initSpaceTracingSeeds(int hSeedDist, int vSeedDist) {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Initializing in-line space tracing seeds ......");
+	// a tiny charH (a page of specks or dithering) gives distances of 0
+	hSeedDist = max(hSeedDist, 1);
+	vSeedDist = max(vSeedDist, 1);
 
 	// initialize space tracing seeds
-	spaceTracingSeeds.clear();
-	for (int i = 0; i < width; i += hSeedDist) {
-		for (int j = 0; j < height; j += vSeedDist) {
-			int x = i, y = j;
-			int origDeriv = blurPixFstOrdParDerivY[x][y];
-
-			// find local whitest point in current pixel column
-			while (origDeriv * blurPixFstOrdParDerivY[x][y] > 0) {
-				if (blurPixFstOrdParDerivY[x][y] > 0) {
-					if (++y >= height) {
-						y = height-1;
-						break;
+	// seeds of each column are searched independently, then gathered in column order
+	int colCnt = (width + hSeedDist - 1) / hSeedDist;
+	vector< vector<Point> > colSeeds(colCnt);
+	parallelFor(0, colCnt, [&](int cb, int ce) {
+		for (int c = cb; c < ce; ++c) {
+			int i = c * hSeedDist;
+			for (int j = 0; j < height; j += vSeedDist) {
+				int x = i, y = j;
+				int origDeriv = blurPixFstOrdParDerivY[x][y];
+
+				// find local whitest point in current pixel column
+				while (origDeriv * blurPixFstOrdParDerivY[x][y] > 0) {
+					if (blurPixFstOrdParDerivY[x][y] > 0) {
+						if (++y >= height) {
+							y = height-1;
+							break;
+						}
 					}
-				}
-				else {
-					if (--y < 0) {
-						y = 0;
-						break;
+					else {
+						if (--y < 0) {
+							y = 0;
+							break;
+						}
 					}
 				}
-			}
 	
-			// only keep seeds in the white space
-			// remove seeds that get trapped in text area
-			if (blurPixScdOrdParDerivY[x][y] < 0)
-				spaceTracingSeeds.push_back(Point(x, y));
+				// only keep seeds in the white space
+				// remove seeds that get trapped in text area
+				if (scdOrdParDerivY(x, y) < 0)
+					colSeeds[c].push_back(Point(x, y));
+			}
 		}
-	}
+	});
+	spaceTracingSeeds.clear();
+	for (int c = 0; c < colCnt; ++c)
+		spaceTracingSeeds.insert(spaceTracingSeeds.end(), colSeeds[c].begin(), colSeeds[c].end());
 }
 
-void HandwrittenImage::traceSpace(int seedX, int seedY) {
+int HandwrittenImage::traceSpace(int seedX, int seedY) {
 	// this point has been traced
-	if (spaceTraces[seedX][seedY] == 1)
-		return;
-
-	// trace[x] = y, store a trace
-	vector<int> trace(width, 0);
-	trace[seedX] = seedY;  // initialize a trace at seed position
-	spaceTraces[seedX][seedY] = 1;
-
-	// seed to right trace
-	for (int x = seedX+1; x < width; ++x) {
+	if (spaceTraces.at(seedX, seedY) == 1)
+		return 0;
+
+	// seed to right trace, starting at the seed
+	int steps = 1;
+	spaceTraces.begin(1);
+	spaceTraces.add(seedX, seedY);
+	for (int x = seedX+1, y = seedY; x < width; ++x) {
 		int preX = x - 1;
-		int preY = trace[preX];
+		int preY = y;
 
 		// move to the whiter area
 		if (blurPixFstOrdParDerivY[preX][preY] > 0)
-			trace[x] = min(preY+1, height-1);
+			y = min(preY+1, height-1);
 		else if (blurPixFstOrdParDerivY[preX][preY] < 0)
-			trace[x] = max(preY-1, 0);
+			y = max(preY-1, 0);
 		else
-			trace[x] = preY;
+			y = preY;
 
 		// if this point has been reached by any other trace, then stop tracing
-		if (spaceTraces[x][trace[x]] == 1)
+		if (spaceTraces.at(x, y) == 1)
 			break;
-		spaceTraces[x][trace[x]] = 1;
+		spaceTraces.add(x, y);
+		++steps;
 	}
 
 	// seed to left trace
-	for (int x = seedX-1; x >= 0; --x) {
+	spaceTraces.begin(1);
+	for (int x = seedX-1, y = seedY; x >= 0; --x) {
 		int preX = x + 1;
-		int preY = trace[preX];
+		int preY = y;
 
 		// move to the whiter area
 		if (blurPixFstOrdParDerivY[preX][preY] > 0)
-			trace[x] = min(preY+1, height-1);
+			y = min(preY+1, height-1);
 		else if (blurPixFstOrdParDerivY[preX][preY] < 0)
-			trace[x] = max(preY-1, 0);
+			y = max(preY-1, 0);
 		else
-			trace[x] = preY;
+			y = preY;
 
 		// if this point has been reached by any other trace, then stop tracing
-		if (spaceTraces[x][trace[x]] == 1)
+		if (spaceTraces.at(x, y) == 1)
 			break;
-		spaceTraces[x][trace[x]] = 1;
+		spaceTraces.add(x, y);
+		++steps;
 	}
+	return steps;
 }
 
 void HandwrittenImage::segmentRegions() {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Segmenting image into line regions ......");
 
-	// 0: space area -1: potential text area
-	spaceTraces = PIXELS(width, vector<int32_t>(height, 0));
+	spaceTraces.reset(width);
 	
+	uint64_t steps = 0;
 	for (size_t i = 0; i < spaceTracingSeeds.size(); ++i) {
-		traceSpace(spaceTracingSeeds[i].x, spaceTracingSeeds[i].y);
+		steps += traceSpace(spaceTracingSeeds[i].x, spaceTracingSeeds[i].y);
 	}
+	StageProfile::count(StageProfile::TRACE_STEPS, steps);
 }
 
 // region area < minArea would be disgarded
@@ -951,15 +1330,13 @@ void HandwrittenImage::labelRegions (int minArea, double minBlackRatio, double m
 	//     -1: untouched potential line region
 	//      0: white space
 	//   1..n: labeled line region
-	regionMap = PIXELS(width, vector<int32_t>(height, -1));
+	resetPixels(regionMap, -1);
 	
 	// draw in-line space onto regionMap
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			if (spaceTraces[x][y] == 1)
-				regionMap[x][y] = 0;
-		}
-	}
+	spaceTraces.forEach([&](int x, int y, int label) {
+		if (label == 1)
+			regionMap[x][y] = 0;
+	});
 	
 	int label = 1;
 	for (int y = 0; y < height; ++y) {  // y == 0 is the top most row, from top to bottom
@@ -978,100 +1355,118 @@ void HandwrittenImage::labelRegions (int minArea, double minBlackRatio, double m
 
 void HandwrittenImage::initTextTracingSeeds(int hSeedDist, int vSeedDist) {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Initializing text tracing seeds ......");
+	// a tiny charH (a page of specks or dithering) gives distances of 0
+	hSeedDist = max(hSeedDist, 1);
+	vSeedDist = max(vSeedDist, 1);
 	
 	// initialize text tracing seeds
-	textTracingSeeds.clear();
-	for (int i = 0; i < width; i += hSeedDist) {
-		for (int j = 0; j < height; j += vSeedDist) {
-			int x = i, y = j;
-			int origDeriv = blurPixFstOrdParDerivY[x][y];
-
-			// find local whitest point in current pixel column
-			while (origDeriv * blurPixFstOrdParDerivY[x][y] > 0) {
-				if (blurPixFstOrdParDerivY[x][y] < 0) {
-					if (++y >= height) {
-						y = height-1;
-						break;
+	// seeds of each column are searched independently, then gathered in column order
+	int colCnt = (width + hSeedDist - 1) / hSeedDist;
+	vector< vector<Point> > colSeeds(colCnt);
+	parallelFor(0, colCnt, [&](int cb, int ce) {
+		for (int c = cb; c < ce; ++c) {
+			int i = c * hSeedDist;
+			for (int j = 0; j < height; j += vSeedDist) {
+				int x = i, y = j;
+				int origDeriv = blurPixFstOrdParDerivY[x][y];
+
+				// find local whitest point in current pixel column
+				while (origDeriv * blurPixFstOrdParDerivY[x][y] > 0) {
+					if (blurPixFstOrdParDerivY[x][y] < 0) {
+						if (++y >= height) {
+							y = height-1;
+							break;
+						}
 					}
-				}
-				else {
-					if (--y < 0) {
-						y = 0;
-						break;
+					else {
+						if (--y < 0) {
+							y = 0;
+							break;
+						}
 					}
 				}
-			}
 	
-			// only keep seeds in the text area
-			// remove seeds that get trapped in space
-			if (blurPixScdOrdParDerivY[x][y] > 0)
-				textTracingSeeds.push_back(Point(x, y));
+				// only keep seeds in the text area
+				// remove seeds that get trapped in space
+				if (scdOrdParDerivY(x, y) > 0)
+					colSeeds[c].push_back(Point(x, y));
+			}
 		}
-	}
+	});
+	textTracingSeeds.clear();
+	for (int c = 0; c < colCnt; ++c)
+		textTracingSeeds.insert(textTracingSeeds.end(), colSeeds[c].begin(), colSeeds[c].end());
 }
 
-void HandwrittenImage::traceText(int seedX, int seedY) {
+int HandwrittenImage::traceText(int seedX, int seedY) {
 	// region id of region that contains the seed
 	int regionID = regionMap[seedX][seedY];
 	// seed point has been traced or this point is in space region, return
-	if (textTraces[seedX][seedY] != 0 || regionID == 0)
-		return;
+	if (textTraces.at(seedX, seedY) != 0 || regionID == 0)
+		return 0;
 
-	// trace[x] = y, store a trace
-	vector<int> trace(width, 0);
-	trace[seedX] = seedY;  // initialize a trace at seed position
-	spaceTraces[seedX][seedY] = regionMap[seedX][seedY];
+	// the seed itself is not part of the text trace, it is marked with the region ID among the space traces
+	spaceTraces.begin(regionID);
+	spaceTraces.add(seedX, seedY);
 
 	// seed to right trace
-	for (int x = seedX+1; x < width; ++x) {
+	int steps = 0;
+	textTraces.begin(regionID);
+	for (int x = seedX+1, y = seedY; x < width; ++x) {
 		int preX = x - 1;
-		int preY = trace[preX];
+		int preY = y;
 
 		// move to the blacker area
 		if (blurPixFstOrdParDerivY[preX][preY] < 0)
-			trace[x] = min(preY+1, height-1);
+			y = min(preY+1, height-1);
 		else if (blurPixFstOrdParDerivY[preX][preY] > 0)
-			trace[x] = max(preY-1, 0);
+			y = max(preY-1, 0);
 		else
-			trace[x] = preY;
+			y = preY;
 
 		// if this point has been reached by any other trace, then stop tracing
 		// or this point reaches region boundary
-		if (textTraces[x][trace[x]] == regionID || regionMap[x][trace[x]] != regionID)
+		if (textTraces.at(x, y) == regionID || regionMap[x][y] != regionID)
 			break;
-		textTraces[x][trace[x]] = regionID;
+		textTraces.add(x, y);
+		++steps;
 	}
 
 	// seed to left trace
-	for (int x = seedX-1; x >= 0; --x) {
+	textTraces.begin(regionID);
+	for (int x = seedX-1, y = seedY; x >= 0; --x) {
 		int preX = x + 1;
-		int preY = trace[preX];
+		int preY = y;
 
 		// move to the whiter area
 		if (blurPixFstOrdParDerivY[preX][preY] < 0)
-			trace[x] = min(preY+1, height-1);
+			y = min(preY+1, height-1);
 		else if (blurPixFstOrdParDerivY[preX][preY] > 0)
-			trace[x] = max(preY-1, 0);
+			y = max(preY-1, 0);
 		else
-			trace[x] = preY;
+			y = preY;
 
 		// if this point has been reached by any other trace, then stop tracing
 		// or this point reaches region boundary
-		if (textTraces[x][trace[x]] == regionID || regionMap[x][trace[x]] != regionID)
+		if (textTraces.at(x, y) == regionID || regionMap[x][y] != regionID)
 			break;
-		textTraces[x][trace[x]] = regionID;
+		textTraces.add(x, y);
+		++steps;
 	}
+	return steps;
 }
 
 void HandwrittenImage::locateTextLineCenters() {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Locate text line center of each region ......");
 
-	// 0: space area -1: potential text area
-	textTraces = PIXELS(width, vector<int32_t>(height, 0));
+	textTraces.reset(width);
 	
+	uint64_t steps = 0;
 	for (size_t i = 0; i < textTracingSeeds.size(); ++i) {
-		traceText(textTracingSeeds[i].x, textTracingSeeds[i].y);
+		steps += traceText(textTracingSeeds[i].x, textTracingSeeds[i].y);
 	}
+	StageProfile::count(StageProfile::TRACE_STEPS, steps);
+	releasePixels(blurPixFstOrdParDerivY, 0);
 }
 
 // if a component intersect with only one text line center, then return the region ID of that text line center
@@ -1081,32 +1476,22 @@ int HandwrittenImage::getComponentRegionID(HandwrittenImage::PIXELS &pix, int xC
 		MsgPrint::msgPrint(MsgPrint::ERR, "Wrong input arguments to call 'getComponentRegionID'");
 	int res = -1;
 	bool multipleCut = false;
-	queue<Point> q;
-	q.push(Point(xCoord, yCoord));
-	while (!q.empty()) {
-		int x = q.front().x;
-		int y = q.front().y;
-		q.pop();
-		if (pix[x][y] == val1) {
-			pix[x][y] = val2;
-
-			if (multipleCut == false && textTraces[x][y] != 0) {
-				if (res == -1)
-					res = textTraces[x][y];
-				else if (res != textTraces[x][y])
-					multipleCut = true;
+	uint64_t runs = spanFill(width, height, xCoord, yCoord, false,
+		[&](int x, int y) { return pix[x][y] == val1; },
+		[&](int x, int y1, int y2) {
+			for (int y = y1; y <= y2; ++y) {
+				pix[x][y] = val2;
+				int traceID = multipleCut ? 0 : textTraces.at(x, y);
+				if (traceID != 0) {
+					if (res == -1)
+						res = traceID;
+					else if (res != traceID)
+						multipleCut = true;
+				}
 			}
+		});
 
-			if (x > 0)
-				q.push(Point(x-1, y));
-			if (x < width-1)
-				q.push(Point(x+1, y));
-			if (y > 0)
-				q.push(Point(x, y-1));
-			if (y < height-1)
-				q.push(Point(x, y+1));
-		}
-	}
+	StageProfile::count(StageProfile::FILL_RUNS, runs);
 
 	if (multipleCut)
 		return -1;
@@ -1118,12 +1503,14 @@ void HandwrittenImage::assignComponentsToRegions() {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Assigning components to text line regions ......");
 
 	textLineMap = binPixBR;
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			if (textLineMap[x][y] == 1)
-				textLineMap[x][y] = -1;
+	parallelFor(0, width, [&](int xb, int xe) {
+		for (int x = xb; x < xe; ++x) {
+			for (int y = 0; y < height; ++y) {
+				if (textLineMap[x][y] == 1)
+					textLineMap[x][y] = -1;
+			}
 		}
-	}
+	});
 
 	// color components that has only one intersection with textL line center
 	for (int x = 0; x < width; ++x) {
@@ -1144,6 +1531,8 @@ void HandwrittenImage::assignComponentsToRegions() {
 			}
 		}
 	}
+	releasePixels(regionMap, outputBit(REGIONS));
+	releasePixels(binPixBR, outputBit(BINPIXBR) | outputBit(CHARH) | outputBit(REGIONS) | outputBit(TEXTTRACES));
 }
 
 // slant correction is line-based
@@ -1151,71 +1540,76 @@ void HandwrittenImage::assignComponentsToRegions() {
 // freeman chain code algorithm is applied for slant angle estimation
 void HandwrittenImage::slantCorrection() {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Correcting text slant ......");
-	// first get startpoint of each connected components
+	// generate chain code of each connected component, only the number of codes of each direction is needed per region
 	// startpoint is the left bottom corner of each components, row is searched first, then column
-	vector<Point> componentStartPoints;
-	PIXELS visited = textLineMap;
-	int maxRegionID = 0;
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			if (visited[x][y] > 0) {
-				maxRegionID = max(visited[x][y], maxRegionID);
-				componentStartPoints.push_back(Point(x, y));
-				colorComponent(visited, x, y, visited[x][y], -1, NEIGHBOR8);  // mark all component as visited
+	// regions (text line regions) are independent tasks, each one searches its bounding box
+	vector<LineBox> boxes = getLineBoxes(textLineMap);
+	int maxRegionID = boxes.size() - 1;
+	vector<int64_t> boxArea(maxRegionID+1);
+	for (int regionID = 1; regionID <= maxRegionID; ++regionID)
+		boxArea[regionID] = boxes[regionID].area();
+	PIXELS &visited = scratchPix;
+	visited = textLineMap;
+	vector< vector<int> > cnt(maxRegionID+1, vector<int>(8, 0));
+	runLineTasks("slantCorrection line", boxArea, [&](int regionID) {
+		const LineBox &box = boxes[regionID];
+		vector<int> cc;
+		uint64_t steps = 0;
+		for (int y = box.yl; y <= box.yh; ++y) {
+			for (int x = box.xl; x <= box.xh; ++x) {
+				if (textLineMap[x][y] == regionID && visited[x][y] == regionID) {
+					markLineComponent(textLineMap, visited, x, y, -1);  // mark all component as visited
+					cc.clear();
+					genComponentChainCode(cc, x, y);
+					for (size_t i = 0; i < cc.size(); ++i)
+						cnt[regionID][cc[i]] += 1;
+					steps += cc.size();
+				}
 			}
 		}
-	}
-
-	vector< vector<int> > cc(maxRegionID+1); // chain code for each region (text line region)
-	for (size_t i = 0; i < componentStartPoints.size(); ++i) {
-		int x = componentStartPoints[i].x;
-		int y = componentStartPoints[i].y;
-		int regionID = textLineMap[x][y];
-		if (regionID > 0) {
-			genComponentChainCode(cc[regionID], x, y);
-		}
-	}
+		StageProfile::count(StageProfile::CHAIN_CODE_STEPS, steps);
+	});
 
 	// calculate slant angle of each region
 	vector<double> slantAngle(maxRegionID+1, PI/2);
 	for (int regionID = 1; regionID <= maxRegionID; ++regionID) {
-		vector<int> cnt(8, 0);
-		for (size_t i = 0; i < cc[regionID].size(); ++i) {
-			cnt[cc[regionID][i]] += 1;
-		}
-		if (cnt[1] - cnt[3] != 0)
-			slantAngle[regionID] = atan((double)(cnt[1]+cnt[2]+cnt[3])/(cnt[1]-cnt[3]));
+		const vector<int> &c = cnt[regionID];
+		if (c[1] - c[3] != 0)
+			slantAngle[regionID] = atan((double)(c[1]+c[2]+c[3])/(c[1]-c[3]));
 	}
 
 	// calculate slant correction reference Y coordinate of each region, here use average Y coordinate of textTrace of each region
 	// use int64_t to avoid overflow
-	vector<int64_t> slantRefY(maxRegionID+1, 0);
-	vector<int64_t> slantRefYCnt(maxRegionID+1, 0);
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			if (textTraces[x][y] > 0) {
-				slantRefY[textTraces[x][y]] += y;
-				slantRefYCnt[textTraces[x][y]] += 1;
-			}
+	// regions without any component in textLineMap are skipped
+	vector<int64_t> slantRefY(maxRegionID+1, 0), slantRefYCnt(maxRegionID+1, 0);
+	textTraces.forEach([&](int, int y, int regionID) {
+		if (regionID <= maxRegionID) {
+			slantRefY[regionID] += y;
+			slantRefYCnt[regionID] += 1;
 		}
-	}
+	});
 	for (int regionID = 1; regionID <= maxRegionID; ++regionID) {
 		if (slantRefYCnt[regionID] != 0)
 			slantRefY[regionID] /= slantRefYCnt[regionID];
 	}
 
 	// do slant correction for each region
-	noSlantTextLineMap = PIXELS(width, vector<int32_t>(height, 0));
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			if (textLineMap[x][y] > 0) {
-				int regionID = textLineMap[x][y];
-				int xOffset = (slantRefY[regionID]-y) * 1/tan(slantAngle[regionID]);
-				if (x + xOffset >= 0 && x + xOffset < width)
-					noSlantTextLineMap[x+xOffset][y] = regionID;
+	// pixels only move within their row, rows are corrected independently, from left to right as in a serial run
+	resetPixels(noSlantTextLineMap, 0);
+	parallelFor(0, height, [&](int yb, int ye) {
+		for (int y = yb; y < ye; ++y) {
+			for (int x = 0; x < width; ++x) {
+				if (textLineMap[x][y] > 0) {
+					int regionID = textLineMap[x][y];
+					int xOffset = (slantRefY[regionID]-y) * 1/tan(slantAngle[regionID]);
+					if (x + xOffset >= 0 && x + xOffset < width)
+						noSlantTextLineMap[x+xOffset][y] = regionID;
+				}
 			}
 		}
-	}
+	});
+	releasePixels(scratchPix, 0);
+	releasePixels(textLineMap, outputBit(TEXTLINES));
 }
 
 // generate chain code representative of a component
@@ -1274,30 +1668,57 @@ void HandwrittenImage::genComponentChainCode(vector<int> &res, int xCoord, int y
 
 void HandwrittenImage::genConvexHullComponents() {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Generating convex hull of all components ......");
-	convexHullPix = noSlantTextLineMap;
-	PIXELS tmpPix = noSlantTextLineMap;
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			if (tmpPix[x][y] > 0) {
-				allConvexHullComponents.push_back(new ConvexHullComponent(tmpPix, x, y, -1));
-
-				// draw the convex hull
-				vector<Point> &v = allConvexHullComponents.back()->vertices;
-				for (size_t i = 0; i < v.size()-1; ++i) {
-					if (v[i] != v[i+1])
-						drawLine(convexHullPix, v[i], v[i+1], -1);
-				}
-				// draw center of gravity
-				Point &gc = allConvexHullComponents.back()->gravityCenter;
-				for (int x = gc.x-2; x <= gc.x+2; ++x) {
-					for (int y = gc.y-2; y <= gc.y+2; ++y) {
-						if (x >= 0 && x < width && y >=0 && y < height)
-							convexHullPix[x][y] = -1;
-					}
+	clearComponents();
+
+	// lines are independent tasks, each one searches its bounding box column by column
+	// pixels of the k-th component of a line are marked as -(k+1) in componentMap
+	componentMap = noSlantTextLineMap;
+	vector<LineBox> boxes = getLineBoxes(noSlantTextLineMap);
+	int maxRegionID = boxes.size() - 1;
+	vector<int64_t> boxArea(maxRegionID+1);
+	for (int regionID = 1; regionID <= maxRegionID; ++regionID)
+		boxArea[regionID] = boxes[regionID].area();
+	vector< vector<ConvexHullComponent *> > lineComponents(maxRegionID+1);
+	runLineTasks("genConvexHullComponents line", boxArea, [&](int regionID) {
+		const LineBox &box = boxes[regionID];
+		vector<ConvexHullComponent *> &components = lineComponents[regionID];
+		for (int x = box.xl; x <= box.xh; ++x) {
+			for (int y = box.yl; y <= box.yh; ++y) {
+				if (noSlantTextLineMap[x][y] == regionID && componentMap[x][y] == regionID) {
+					int mark = -(int)components.size() - 1;
+					components.push_back(new ConvexHullComponent(noSlantTextLineMap, componentMap, x, y, mark));
 				}
 			}
 		}
+	});
+
+	// make component labels unique over the page, components of line l are numbered after those of lines 1..l-1
+	vector<int> lineBase(maxRegionID+1, 0);
+	for (int regionID = 1; regionID <= maxRegionID; ++regionID)
+		lineBase[regionID] = lineBase[regionID-1] + lineComponents[regionID-1].size();
+	parallelFor(0, width, [&](int xb, int xe) {
+		for (int x = xb; x < xe; ++x) {
+			for (int y = 0; y < height; ++y) {
+				if (componentMap[x][y] < 0)
+					componentMap[x][y] -= lineBase[noSlantTextLineMap[x][y]];
+			}
+		}
+	});
+	for (int regionID = 1; regionID <= maxRegionID; ++regionID) {
+		for (size_t i = 0; i < lineComponents[regionID].size(); ++i) {
+			lineComponents[regionID][i]->mark -= lineBase[regionID];
+			allConvexHullComponents.push_back(lineComponents[regionID][i]);
+		}
 	}
+
+	// restore the order of a column by column scan over the page, so that ties in the sort below are broken as before
+	sort(allConvexHullComponents.begin(), allConvexHullComponents.end(),
+			[](const ConvexHullComponent *a, const ConvexHullComponent *b) {
+				if (a->startPoint.x == b->startPoint.x)
+					return a->startPoint.y < b->startPoint.y;
+				return a->startPoint.x < b->startPoint.x;
+			}
+		);
 	sort(allConvexHullComponents.begin(), allConvexHullComponents.end(),
 			[](const ConvexHullComponent *a, const ConvexHullComponent *b) {
 				if (a->regionID == b->regionID)
@@ -1305,178 +1726,181 @@ void HandwrittenImage::genConvexHullComponents() {
 				return a->regionID < b->regionID;
 			}
 		);
+	for (size_t i = 0; i < allConvexHullComponents.size(); ++i)
+		allConvexHullComponents[i]->index = i;
+	// the convex hulls are drawn over it when the CONVEXHULL output is written
+	releasePixels(noSlantTextLineMap, outputBit(NOSLANT) | outputBit(CONVEXHULL));
 }
 
-struct HandwrittenImage::WordBBox {
-	int wordID;
-	int regionID;
-	int xl, xh, yl, yh;
-	WordBBox (int _wordID, int _regionID, int _xl, int _xh, int _yl, int _yh) {
-		wordID = _wordID;
-		regionID = _regionID;
-		xl = _xl;
-		xh = _xh;
-		yl = _yl;
-		yh = _yh;
-	}
+struct HandwrittenImage::ComponentDistance {
+	double dist;
+	Point a, b;  // end points of the gap between two convex hulls
 };
 
+static uint64_t distanceKey(int from, int to) {
+	return ((uint64_t)from << 32) | (uint32_t)to;
+}
+
+// distance between allConvexHullComponents[from] and allConvexHullComponents[to]
+// taken from the cache if it is on, or calculated and appended to computed, which is added to the cache once concurrent readers are done
+HandwrittenImage::ComponentDistance HandwrittenImage::getComponentDistance(int from, int to, DistanceList &computed) const {
+	uint64_t key = distanceKey(from, to);
+	if (cacheDistances) {
+		unordered_map<uint64_t, ComponentDistance>::const_iterator it = componentDistances.find(key);
+		if (it != componentDistances.end())
+			return it->second;
+	}
+	ComponentDistance d;
+	d.dist = allConvexHullComponents[from]->getDistance(allConvexHullComponents[to], d.a.x, d.a.y, d.b.x, d.b.y);
+	computed.push_back(make_pair(key, d));
+	return d;
+}
+
 void HandwrittenImage::extractWord(double centerStrapWidth, int minW, int minH, double threshold, double alpha) {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Extracting words ......");
 
-	vector< vector<ConvexHullComponent *> > componentsOnTextTrace;
-
-	for (size_t index = 0; index < allConvexHullComponents.size(); ++index) {
-		ConvexHullComponent *chc = allConvexHullComponents[index];
-		if ((chc->xh - chc->xl < minW) || (chc->yh - chc->yl < minH))
-			continue;
+	// allConvexHullComponents is sorted by regionID then gravity center, so each region is a contiguous range
+	// components of region id are [regionSt[id], regionSt[id+1])
+	int n = allConvexHullComponents.size();
+	int maxRegionID = (n == 0) ? 0 : allConvexHullComponents[n-1]->regionID;
+	vector<int> regionSt(maxRegionID+2, 0);
+	for (int i = 0; i < n; ++i)
+		regionSt[allConvexHullComponents[i]->regionID+1] += 1;
+	vector<int64_t> regionSize(maxRegionID+1);
+	for (int id = 0; id <= maxRegionID; ++id) {
+		regionSize[id] = regionSt[id+1];
+		regionSt[id+1] += regionSt[id];
+	}
+
+	// regions are independent tasks, word IDs are numbered from 1 within each region first
+	vector<int> regionWordCnt(maxRegionID+1, 0);
+	vector< vector<ComponentDistance> > regionGaps(maxRegionID+1);  // gaps between adjacent components on the textTraces
+	vector<DistanceList> computed(maxRegionID+1);  // distances calculated by each region, cached after all regions are done if the cache is on
+	runLineTasks("extractWord line", regionSize, [&](int id) {
+		int st = regionSt[id], ed = regionSt[id+1];
+		for (int i = st; i < ed; ++i)
+			allConvexHullComponents[i]->wordID = -1;
 
-		int id = chc->regionID;
-		// avoid out_of_range
-		for (int k = componentsOnTextTrace.size(); k <= id; ++k) {
-			componentsOnTextTrace.push_back(vector<ConvexHullComponent *>());
-		}
 		// only add components that intersect with textTraces center strap (center - 1/6*charH, cneter + 1/6*charH)
-		int x = chc->gravityCenter.x;
-		for (int y = chc->yl - centerStrapWidth/2*charH; y <= chc->yh + centerStrapWidth/2*charH; ++y) {
-			if (textTraces[x][y] == id) {
-				componentsOnTextTrace[id].push_back(chc);
-				break;
-			}
+		vector<int> onTrace;
+		for (int i = st; i < ed; ++i) {
+			ConvexHullComponent *chc = allConvexHullComponents[i];
+			if ((chc->xh - chc->xl < minW) || (chc->yh - chc->yl < minH))
+				continue;
+			int yl = chc->yl - centerStrapWidth/2*charH;
+			int yh = floor(chc->yh + centerStrapWidth/2*charH);
+			if (textTraces.passes(chc->gravityCenter.x, yl, yh, id))
+				onTrace.push_back(i);
 		}
-	}
 
-	// assign components on the textTraces to their corresponding words
-	int curWordID = 1;
-	for (size_t region_id = 0; region_id < componentsOnTextTrace.size(); ++region_id) {
+		// assign components on the textTraces to their corresponding words
 		vector<double> gaps;
 		gaps.push_back(width);  // leftgap of the first component is postive infinity
-		for (int cc = 0; cc < (int)componentsOnTextTrace[region_id].size()-1; ++cc) {
-			int xl = -1, xh = -1, yl = -1, yh = -1;
-			double dist = componentsOnTextTrace[region_id][cc]->getDistance(componentsOnTextTrace[region_id][cc+1], xl, yl, xh, yh);
-			gaps.push_back(dist);
-
-			if (dist != 0)
-				drawLine(convexHullPix, Point(xl, yl), Point(xh, yh), 12);
+		for (int cc = 0; cc < (int)onTrace.size()-1; ++cc) {
+			ComponentDistance d = getComponentDistance(onTrace[cc], onTrace[cc+1], computed[id]);
+			gaps.push_back(d.dist);
+			regionGaps[id].push_back(d);
 		}
 		gaps.push_back(width);  // rightgap of the last component is positive infinity
 
+		int wordCnt = 0;
 		if (gaps.size() > 2) { // region contain at least valid component
 			GroupTree gTree(gaps, threshold, alpha);
 			gTree.grouping();
 			vector< pair<int, int> > groups = gTree.getGroupingResult();
 			for (size_t i = 0; i < groups.size(); ++i) {
+				wordCnt += 1;
 				for (int k = groups[i].first; k <= groups[i].second; ++k) {
-					componentsOnTextTrace[region_id][k]->wordID = curWordID;
+					allConvexHullComponents[onTrace[k]]->wordID = wordCnt;
 				}
-				curWordID += 1;
 			}
 		}
-	}
-
-	// assign components off the textTraces to their closest assigned component's wordID
-	for (size_t i = 0; i < allConvexHullComponents.size(); ++i) {
-		ConvexHullComponent *ptr = allConvexHullComponents[i];
-		if (ptr->wordID == -1) {  // unassigned component
-			double leftDist = 0, rightDist = 0;
-
-			// find closest assigned component on the left
-			int left = i-1;
-			while (left >= 0 && allConvexHullComponents[left]->wordID == -1) --left;
-			if (left < 0 || allConvexHullComponents[left]->regionID != ptr->regionID) // there is no component on the left
-				leftDist = width;
-			else {
-				int x1 = -1, y1 = -1, x2 = -1, y2 = -1;
-				leftDist = ptr->getDistance(allConvexHullComponents[left], x1, y1, x2, y2);
-				//if (leftDist != 0)
-				//	drawLine(convexHullPix, Point(x1, y1), Point(x2, y2), 12);
-			}
-
-			// find closest assigned component on the right
-			unsigned right = i+1;
-			while (right < allConvexHullComponents.size() && allConvexHullComponents[right]->wordID == -1) ++right;
-			if (right >= allConvexHullComponents.size() || allConvexHullComponents[right]->regionID != ptr->regionID)  // there is no components on the right
-				rightDist = width;
-			else {
-				int x1 = -1, y1 = -1, x2 = -1, y2 = -1;
-				rightDist = ptr->getDistance(allConvexHullComponents[right], x1, y1, x2, y2);
-				//if (rightDist != 0)
-				//	drawLine(convexHullPix, Point(x1, y1), Point(x2, y2), 12);
-			}
 
-			if (leftDist < rightDist)
+		// assign components off the textTraces to their closest assigned component's wordID
+		// components are handled from left to right, hence when a component is handled all components on its left are
+		// already assigned, and its closest assigned component on the left is simply the previous component of the region.
+		// closest assigned component on the right is always an on-trace one, it is found by a right to left sweep.
+		vector<int> rightAssigned(ed-st, -1);
+		for (int i = ed-2; i >= st; --i)
+			rightAssigned[i-st] = (allConvexHullComponents[i+1]->wordID != -1) ? i+1 : rightAssigned[i+1-st];
+
+		for (int i = st; i < ed; ++i) {
+			ConvexHullComponent *ptr = allConvexHullComponents[i];
+			if (ptr->wordID != -1)  // component on the textTraces
+				continue;
+			int left = (i > st) ? i-1 : -1, right = rightAssigned[i-st];
+			double leftDist = (left == -1) ? width : getComponentDistance(i, left, computed[id]).dist;
+			double rightDist = (right == -1) ? width : getComponentDistance(i, right, computed[id]).dist;
+
+			// a missing neighbour counts as width away, a component can be even farther (a page of tiny specks)
+			if (leftDist < rightDist && left != -1)
 				ptr->wordID = allConvexHullComponents[left]->wordID;
-			else if (leftDist > rightDist)
+			else if (leftDist > rightDist && right != -1)
 				ptr->wordID = allConvexHullComponents[right]->wordID;
-			else {  //leftDist == rightDist
-				if (leftDist == width) { // component is the only component in region and off the textTrace
-					// keep words in order
-					if (i == 0)
-						ptr->wordID = 1;
-					else
-						ptr->wordID = allConvexHullComponents[i-1]->wordID + 1;
-					for (size_t k = i+1; k < allConvexHullComponents.size(); ++k) {
-						if (allConvexHullComponents[k]->wordID != -1)
-							allConvexHullComponents[k]->wordID += 1;
-					}
-				}
-				else
-					ptr->wordID = allConvexHullComponents[left]->wordID;
-			}
+			else if (leftDist == width)  // component is the only component in region and off the textTrace, start a new word
+				ptr->wordID = ++wordCnt;
+			else
+				ptr->wordID = allConvexHullComponents[left]->wordID;
 		}
-	}
 
-	// update wordMap
-	wordMap = noSlantTextLineMap;
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			wordMap[x][y] *= -1;
+		// renumber words in order of appearance, so that word IDs keep increasing from left to right
+		vector<int> orderedWordID(wordCnt+1, -1);
+		int nextWordID = 1;
+		for (int i = st; i < ed; ++i) {
+			int &wordID = orderedWordID[allConvexHullComponents[i]->wordID];
+			if (wordID == -1)
+				wordID = nextWordID++;
+			allConvexHullComponents[i]->wordID = wordID;
+		}
+		regionWordCnt[id] = nextWordID-1;
+	});
+
+	wordGaps.clear();
+	uint64_t distanceCalls = 0;
+	for (int id = 1; id <= maxRegionID; ++id) {
+		if (cacheDistances)
+			componentDistances.insert(computed[id].begin(), computed[id].end());
+		distanceCalls += computed[id].size();
+		for (size_t i = 0; i < regionGaps[id].size(); ++i) {
+			if (regionGaps[id][i].dist != 0)
+				wordGaps.push_back(make_pair(regionGaps[id][i].a, regionGaps[id][i].b));
 		}
 	}
-	for (size_t i = 0; i < allConvexHullComponents.size(); ++i) {
+	StageProfile::count(StageProfile::DISTANCE_CALLS, distanceCalls);
+
+	// word IDs keep increasing line by line: words of region id are numbered after the words of regions 1..id-1
+	vector<int> wordBase(maxRegionID+1, 0);
+	for (int id = 1; id <= maxRegionID; ++id)
+		wordBase[id] = wordBase[id-1] + regionWordCnt[id-1];
+	for (int i = 0; i < n; ++i)
+		allConvexHullComponents[i]->wordID += wordBase[allConvexHullComponents[i]->regionID];
+
+	// word ID of each component, indexed by component label in componentMap
+	componentWordID.assign(n, 0);
+	for (int i = 0; i < n; ++i) {
 		ConvexHullComponent *ptr = allConvexHullComponents[i];
-		int x = ptr->startPoint.x, y = ptr->startPoint.y;
-		colorComponent(wordMap, x, y, wordMap[x][y], ptr->wordID, NEIGHBOR4);
+		componentWordID[-ptr->mark-1] = ptr->wordID;
 	}
 
-	// generate WordBBox for each word
-	map< int, array<int, 5> > allBBox;
-	for (int x = 0; x < width; ++x) {
-		for (int y = 0; y < height; ++y) {
-			int wordID = wordMap[x][y];
-			if (wordID > 0) {
-				if (allBBox.find(wordID) != allBBox.end()) {
-					allBBox[wordID][1] = min(allBBox[wordID][1], x);  // xl
-					allBBox[wordID][2] = max(allBBox[wordID][2], x);  // xh
-					allBBox[wordID][3] = min(allBBox[wordID][3], y);  // yl
-					allBBox[wordID][4] = max(allBBox[wordID][4], y);  // yh
-				}
-				else {
-					allBBox[wordID][0] = noSlantTextLineMap[x][y];  // regionID
-					allBBox[wordID][1] = x;  // xl
-					allBBox[wordID][2] = x;  // xh
-					allBBox[wordID][3] = y;  // yl
-					allBBox[wordID][4] = y;  // yh
-				}
-			}
-		}
-	}
+	// generate WordBBox for each word, word bounding box is the union of its components' bounding boxes
+	// word IDs are numbered in order of appearance, so allWordBBox[wordID-1] is the bounding box of word wordID
 	allWordBBox.clear();
-	for (map< int, array<int, 5> >::iterator it = allBBox.begin(); it != allBBox.end(); ++it) {
-		allWordBBox.push_back(WordBBox(it->first, (it->second)[0], (it->second)[1], (it->second)[2], (it->second)[3], (it->second)[4]));
-
-		/*
-		// draw bbox
-		WordBBox &w = allWordBBox.back();
-		drawLine(wordMap, Point(w.xl, w.yl), Point(w.xl, w.yh), -1);
-		drawLine(wordMap, Point(w.xl, w.yh), Point(w.xh, w.yh), -1);
-		drawLine(wordMap, Point(w.xh, w.yh), Point(w.xh, w.yl), -1);
-		drawLine(wordMap, Point(w.xh, w.yl), Point(w.xl, w.yl), -1);
-		*/
+	for (int i = 0; i < n; ++i) {
+		ConvexHullComponent *ptr = allConvexHullComponents[i];
+		if (ptr->wordID > (int)allWordBBox.size()) {  // first component of the word
+			allWordBBox.push_back(WordBBox(ptr->wordID, ptr->regionID, ptr->xl, ptr->xh, ptr->yl, ptr->yh));
+		}
+		else {
+			WordBBox &w = allWordBBox[ptr->wordID-1];
+			w.xl = min(w.xl, ptr->xl);
+			w.xh = max(w.xh, ptr->xh);
+			w.yl = min(w.yl, ptr->yl);
+			w.yh = max(w.yh, ptr->yh);
+		}
 	}
 }
 
-void HandwrittenImage::drawLine(PIXELS &pix, Point a, Point b, int val) {
+void HandwrittenImage::drawLine(PIXELS &pix, Point a, Point b, int val) const {
 	if (a == b)
 		return;
 	if (abs(a.x - b.x) > abs(a.y - b.y)) {
@@ -1499,21 +1923,45 @@ void HandwrittenImage::drawLine(PIXELS &pix, Point a, Point b, int val) {
 	}
 }
 
-void HandwrittenImage::writeWords(const char *basename) const {
+void HandwrittenImage::writeWords(const char *basename, vector<std::string> *fileNames) const {
 	MsgPrint::msgPrint(MsgPrint::INFO, "Writing out all words ......");
+
+	// words of a line are consecutive in allWordBBox, lines are written as independent tasks
+	int maxRegionID = allWordBBox.empty() ? 0 : allWordBBox.back().regionID;
+	vector<int> lineSt(maxRegionID+2, 0);
+	vector<int64_t> lineArea(maxRegionID+1, 0);
+	for (size_t i = 0; i < allWordBBox.size(); ++i) {
+		const WordBBox &w = allWordBBox[i];
+		lineSt[w.regionID+1] += 1;
+		lineArea[w.regionID] += (int64_t)(w.xh-w.xl+1)*(w.yh-w.yl+1);
+	}
+	for (int id = 0; id <= maxRegionID; ++id)
+		lineSt[id+1] += lineSt[id];
+
+	vector<std::string> names(allWordBBox.size());
 	for (size_t i = 0; i < allWordBBox.size(); ++i) {
 		const WordBBox &w = allWordBBox[i];
-		PIXELS oneWordPix = PIXELS(w.xh-w.xl+1, vector<int32_t>(w.yh-w.yl+1, 0));
-		for (int x = w.xl; x <= w.xh; ++x) {
-			for (int y = w.yl; y <= w.yh; ++y) {
-				if (wordMap[x][y] == w.wordID) {
-					oneWordPix[x-w.xl][y-w.yl] = 1;
-				}
-			}
-		}
 		char fileName[1000];
 		sprintf(fileName, "%s_line-%d_word-%d_x-%d_y-%d_width-%d_height-%d.bmp",
 				basename, w.regionID, w.wordID, w.xl, w.yl, w.xh-w.xl+1, w.yh-w.yl+1);
-		writeOneBitBMP(fileName, oneWordPix);
-	}
+		names[i] = fileName;
+	}
+	if (fileNames != NULL)
+		fileNames->insert(fileNames->end(), names.begin(), names.end());
+
+	runLineTasks("writeWords line", lineArea, [&](int id) {
+		for (int i = lineSt[id]; i < lineSt[id+1]; ++i) {
+			const WordBBox &w = allWordBBox[i];
+			PIXELS oneWordPix = PIXELS(w.xh-w.xl+1, vector<int32_t>(w.yh-w.yl+1, 0));
+			for (int x = w.xl; x <= w.xh; ++x) {
+				for (int y = w.yl; y <= w.yh; ++y) {
+					int label = componentMap[x][y];
+					if (label < 0 && componentWordID[-label-1] == w.wordID) {
+						oneWordPix[x-w.xl][y-w.yl] = 1;
+					}
+				}
+			}
+			writeOneBitBMP(names[i].c_str(), oneWordPix);
+		}
+	});
 }
@@ -3,11 +3,21 @@
 
 #include <cstdint>
 #include <vector>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <string>
 #include "Point.h"
+#include "TraceMap.h"
 using std::vector;
+using std::unordered_map;
+using std::function;
 using std::swap;
 
 class ConvexHullComponent;
+class ThreadPool;
+class ByteWriter;
+class ByteReader;
 
 class HandwrittenImage {
 public:
@@ -15,10 +25,49 @@ public:
 		          SPACETRACES, REGIONS, TEXTTRACINGSEEDS, TEXTTRACES, TEXTLINES, NOSLANT, CONVEXHULL, WORDMAP};
 	typedef vector< vector<int32_t> > PIXELS;
 
+	struct WordBBox {
+		int wordID;
+		int regionID;
+		int xl, xh, yl, yh;
+		WordBBox (int _wordID, int _regionID, int _xl, int _xh, int _yl, int _yh) {
+			wordID = _wordID;
+			regionID = _regionID;
+			xl = _xl;
+			xh = _xh;
+			yl = _yl;
+			yh = _yh;
+		}
+	};
+
+	// groups of stages whose results can be saved and restored, in pipeline order
+	//   BORDER: removeBorder, CHARH: calcCharHeight, DERIVATIVES: blur and the partial derivatives of Y,
+	//   REGIONS: space tracing up to labelRegions, TEXTLINES: text tracing up to assignComponentsToRegions,
+	//   HULLS: slantCorrection and genConvexHullComponents
+	enum CHECKPOINT {CKPT_BORDER, CKPT_CHARH, CKPT_DERIVATIVES, CKPT_REGIONS, CKPT_TEXTLINES, CKPT_HULLS, CKPT_COUNT};
+
+	static const uint32_t ALL_OUTPUTS = ~0u;
+	static uint32_t outputBit(PIXTYPE type) { return 1u << type; }
+
 	HandwrittenImage();
 	~HandwrittenImage();
+	void setThreadPool(ThreadPool *pool) { threadPool = pool; }
+	// outputs that will be written after segmentation, a mask of outputBit(PIXTYPE), writeWords is always available
+	void setOutputTypes(uint32_t mask) { outputTypes = mask; }
+	uint32_t getOutputTypes() const { return outputTypes; }
+	// 0: whole-page processing, otherwise the pixel planes of a page are kept within megabytes, planes of requested outputs aside:
+	// the border, blur and derivative stages run band by band and planes are freed once consumed,
+	// the later stages still need TILED_PAGE_PLANES whole-page planes, a smaller budget is warned about
+	void setTileMemoryBudget(double megabytes) { tileMemoryBudget = (int64_t)(megabytes * (1 << 20)); }
 	void readOneBitBMP(const char *fileName);
+	// read an image from memory, rows from the top, stride bytes apart, one byte per pixel
+	// a pixel is black if it is nonzero, or for gray images if it is below grayThreshold
+	void readPixels(const uint8_t *pixels, int width, int height, int stride, bool gray, int grayThreshold);
 	void writeBMP(const char *fileName, PIXTYPE type) const;
+	// the state a checkpoint's stages produce, restoring checkpoints in order replaces running their stages
+	// state saved in tiled mode or for other output types must only be restored under the same settings
+	void saveCheckpoint(CHECKPOINT ckpt, ByteWriter &writer) const;
+	// return false if the data is malformed, the stages of the checkpoint must be run again then
+	bool loadCheckpoint(CHECKPOINT ckpt, ByteReader &reader);
 
 	void removeBorder(double hWeight, double vWeight, double threshold);
 	void calcCharHeight(double diffPct, double cutoffFactor);
@@ -34,53 +83,105 @@ public:
 	void slantCorrection();
 	void genConvexHullComponents();
 	void extractWord(double centerStrapWidth, int minW, int minH, double threshold, double alpha);
-	void writeWords(const char *basename) const;
+	// keep the convex hull distances extractWord calculates for its later runs on the same components (other word settings)
+	// a single run never needs a distance twice, so this is off by default
+	void setDistanceCache(bool on) { cacheDistances = on; }
+	// fileNames: if not NULL, names of the written files are appended
+	void writeWords(const char *basename, vector<std::string> *fileNames = NULL) const;
 
-	int getWidth() { return width; }
-	int getHeight() { return height; }
-	int getCharH() { return charH; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getCharH() const { return charH; }
+	// black pixels of the image as read, before border removal
+	int64_t countInkPixels() const;
+	// connected components of genConvexHullComponents, and the text line regions holding them
+	int getComponentCount() const { return allConvexHullComponents.size(); }
+	int getRegionCount() const;
+	// words found by extractWord, allWordBBox[i] is word i+1
+	const vector<WordBBox> &getWordBoxes() const { return allWordBBox; }
+	// copy a label plane of the segmented page to labels, row by row, width*height values, 0 for other pixels
+	//   NOSLANT: line ID of the pixels of a line, WORDMAP: word ID of the pixels of a word, both in the coordinates of the word boxes
+	// in tiled mode the plane must be among the output types
+	void getLabels(PIXTYPE type, int32_t *labels) const;
 private:
 	struct ComponentInfo;
 	struct RegionInfo;
-	struct WordBBox;
+	struct ComponentDistance;
+	struct LineBox;
+	typedef vector< std::pair<uint64_t, ComponentDistance> > DistanceList;
 
 	enum COLOR {BIN, GRAY, RGB};
 	enum CONNMODE {NEIGHBOR4, NEIGHBOR8};
 
-	void traceSpace(int seedX, int seedY);
-	void traceText(int seedX, int seedY);
+	// outputs drawn from blurPix
+	static const uint32_t BLUR_OUTPUTS = (1u << BLURPIX) | (1u << SPACETRACINGSEEDS) | (1u << SPACETRACES) | (1u << TEXTTRACINGSEEDS);
+
+	void resetPixels(PIXELS &pix, int32_t val) const;
+	void releasePixels(PIXELS &pix, uint32_t outputs);
+	// whole-page planes live at once in tiled mode, binPixBR, the first-order derivative and regionMap in labelRegions
+	static const int TILED_PAGE_PLANES = 3;
+	bool tiled() const { return tileMemoryBudget > 0; }
+	bool outputRequested(uint32_t outputs) const { return (outputTypes & outputs) != 0; }
+	int64_t planeBytes() const { return (int64_t)width * height * sizeof(int32_t); }
+	int bandRows(int64_t bytesPerRow, int halo, int planes) const;
+	vector<LineBox> getLineBoxes(const PIXELS &lineMap) const;
+	// name: shown for the line tasks in the timeline
+	void runLineTasks(const char *name, const vector<int64_t> &lineCost, const function<void(int)> &task) const;
+	void clearComponents();
+	void parallelFor(int first, int last, const function<void(int, int)> &func) const;
+	template <class T>
+	T parallelReduce(int first, int last, const T &init, const function<T(int, int)> &func, const function<T(const T&, const T&)> &combine) const;
+
+	void removeBorderTiled(double hWeight, double vWeight, double threshold);
+	void blurRows(int yb, int ye, PIXELS &dst, int dstY0) const;
+	void partialDerivY(const PIXELS &src, int srcY0, PIXELS &dst, int dstY0, int yb, int ye, int ofs) const;
+	int scdOrdParDerivY(int x, int y) const;
+	// return the number of points traced
+	int traceSpace(int seedX, int seedY);
+	int traceText(int seedX, int seedY);
 	void genComponentChainCode(vector<int> &res, int xCoord, int yCoord);
 
 	ComponentInfo getComponentInfo(PIXELS &pix, int xCoord, int yCoord, int val1, int val2);
 	RegionInfo getRegionInfo(PIXELS &pix, int xCoord, int yCoord, int val1, int val2);
 	void colorComponent(PIXELS &pix, int xCoord, int yCoord, int val1, int val2, CONNMODE mode);
 	void colorRegion(PIXELS &pix, int xCoord, int yCoord, int val1, int val2);
+	void markLineComponent(const PIXELS &lineMap, PIXELS &visited, int xCoord, int yCoord, int val) const;
 	int getComponentRegionID(PIXELS &pix, int xCoord, int yCoord, int val1, int val2);
 
 	void writeOneBitBMP(const char *fileName, const PIXELS &pix) const;
 	void write24BitBMP(const char *fileName, const PIXELS &pix, COLOR color) const;
 
-	void drawLine(PIXELS &pix, Point a, Point b, int val);
+	void drawLine(PIXELS &pix, Point a, Point b, int val) const;
+	ComponentDistance getComponentDistance(int from, int to, DistanceList &computed) const;
 
 	PIXELS binPix;  // original binary pixels
 	PIXELS binPixBR;  // border removed binary pixels
 	PIXELS blurPix;  // blur pixels in grayscale
 	PIXELS blurPixFstOrdParDerivY;  // blurPix first-order partial derivative of Y
 	PIXELS blurPixScdOrdParDerivY;  // blurPix second-order partial derivative of Y
-	PIXELS spaceTraces;  // in-line space traces
+	TraceMap spaceTraces;  // in-line space traces, label 1
 	PIXELS regionMap;  // store line regions
-	PIXELS textTraces;  // text line traces
+	TraceMap textTraces;  // text line traces, labeled with their region ID
 	PIXELS textLineMap;  // store text lines, in this map all components are assigned to their corresponding lines
 	PIXELS noSlantTextLineMap;  // store no slant text lines map
-	PIXELS convexHullPix;
-	PIXELS wordMap;
+	PIXELS scratchPix;  // temporary plane, reused by stages
+	PIXELS componentMap;  // component label of each pixel, -(k+1) for the k-th generated convex hull component
 	vector<Point> spaceTracingSeeds;
 	vector<Point> textTracingSeeds;
 	vector<ConvexHullComponent *> allConvexHullComponents;
 	vector<WordBBox> allWordBBox;
+	vector< std::pair<Point, Point> > wordGaps;  // gaps between adjacent components on the text traces, only drawn for output
+	vector<int> componentWordID;  // word ID of the k-th generated convex hull component
+	unordered_map<uint64_t, ComponentDistance> componentDistances;  // cached getDistance results, key: (from index << 32) | to index
+	bool cacheDistances;  // set by setDistanceCache
 	int width;   // image width in pixel
 	int height;  // image height in pixel
 	int charH;   // average character height
+	int blurWinW, blurWinH;  // blur window
+	int scdWinH;  // window height of the second-order partial derivative of Y
+	uint32_t outputTypes;  // outputs requested by setOutputTypes
+	int64_t tileMemoryBudget;  // bytes of pixel planes in tiled mode, 0: tiling is off
+	ThreadPool *threadPool;  // runs data-parallel loops, NULL: run single-threaded
 };
 
 #endif
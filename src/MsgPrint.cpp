@@ -2,16 +2,35 @@
 #include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <atomic>
 #include "MsgPrint.h"
 
+static std::atomic<int> errAction(MsgPrint::EXIT);
+static std::atomic<int> level(MsgPrint::INFO);
+static thread_local char context[256] = "";
+
+void MsgPrint::setErrAction(ERRACTION action) {
+	errAction = action;
+}
+
+void MsgPrint::setLevel(SEVERE l) {
+	level = l;
+}
+
+void MsgPrint::setContext(const char *ctx) {
+	if (ctx == NULL)
+		ctx = "";
+	snprintf(context, sizeof(context), "%s", ctx);
+}
+
 void MsgPrint::msgPrint(SEVERE s, const char *msg) {
 	time_t rawTime;
 	char timeStr[10];
-	struct tm * timeInfo;
+	struct tm timeInfo;
 
 	time(&rawTime);
-	timeInfo = localtime(&rawTime);
-	strftime(timeStr, sizeof(timeStr), "%H:%M:%S", timeInfo);
+	localtime_r(&rawTime, &timeInfo);
+	strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &timeInfo);
 	char typeStr[5];
 
 	switch(s) {
@@ -25,7 +44,15 @@ void MsgPrint::msgPrint(SEVERE s, const char *msg) {
 			strcpy(typeStr, "ERR");
 			break;
 	}
-	fprintf(stderr, "[%s][%s] %s\n", typeStr, timeStr, msg);
-	if (s == ERR)
+	if (s <= level) {
+		if (context[0] != '\0')
+			fprintf(stderr, "[%s][%s][%s] %s\n", typeStr, timeStr, context, msg);
+		else
+			fprintf(stderr, "[%s][%s] %s\n", typeStr, timeStr, msg);
+	}
+	if (s == ERR) {
+		if (errAction == THROW)
+			throw Error(msg);
 		exit(1);
+	}
 }
@@ -1,10 +1,24 @@
 #ifndef __MSGPRINT_H__
 #define __MSGPRINT_H__
 
+#include <stdexcept>
+#include <string>
+
 class MsgPrint {
 public:
 	enum SEVERE {ERR, WARN, INFO};
+	// what an ERR message does: EXIT the process, or THROW a MsgPrint::Error (batch mode, one failing page must not stop the others)
+	enum ERRACTION {EXIT, THROW};
+	struct Error : public std::runtime_error {
+		Error(const std::string &msg) : std::runtime_error(msg) {}
+	};
+
 	static void msgPrint(SEVERE s, const char *msg);
+	static void setErrAction(ERRACTION action);
+	// messages less severe than level are not printed, e.g. WARN: errors and warnings only
+	static void setLevel(SEVERE level);
+	// tag messages printed by the calling thread with ctx (e.g. page name), NULL or "" to remove the tag
+	static void setContext(const char *ctx);
 };
 
 #endif
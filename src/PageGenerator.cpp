@@ -0,0 +1,266 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "PageGenerator.h"
+#include "MsgPrint.h"
+
+using std::min;
+using std::max;
+
+map<string, double> PageGenerator::defaults() {
+	map<string, double> p;
+	p["seed"] = 1;
+	p["dpi"] = 150;
+	p["page_width"] = 8.5;
+	p["page_height"] = 11;
+	p["margin"] = 0.75;
+	p["char_height"] = 0.16;
+	p["lines"] = 0;
+	p["line_spacing"] = 2.5;
+	p["slant"] = 0.3;
+	p["density"] = 1;
+	p["stroke"] = 0.12;
+	p["border"] = 1;
+	p["ruling"] = 0;
+	p["noise"] = 1;
+	p["pattern"] = 0;
+	return p;
+}
+
+PageGenerator::PageGenerator(const map<string, double> &params) {
+	this->params = defaults();
+	for (map<string, double>::const_iterator it = params.begin(); it != params.end(); ++it) {
+		if (this->params.count(it->first) == 0)
+			MsgPrint::msgPrint(MsgPrint::ERR, ("Unknown page generator parameter " + it->first).c_str());
+		this->params[it->first] = it->second;
+	}
+	double dpi = this->params["dpi"];
+	width = max(1, (int)round(this->params["page_width"] * dpi));
+	height = max(1, (int)round(this->params["page_height"] * dpi));
+	charH = max(2.0, this->params["char_height"] * dpi);
+}
+
+void PageGenerator::clear() {
+	rng.seed((uint32_t)params["seed"]);
+	pix.assign((size_t)width * height, 0);
+}
+
+void PageGenerator::disk(double x, double y, double r) {
+	int xl = max(0, (int)floor(x - r)), xh = min(width-1, (int)ceil(x + r));
+	int yl = max(0, (int)floor(y - r)), yh = min(height-1, (int)ceil(y + r));
+	double r2 = max(r*r, 0.25);
+	for (int j = yl; j <= yh; ++j) {
+		for (int i = xl; i <= xh; ++i) {
+			if ((i-x)*(i-x) + (j-y)*(j-y) <= r2)
+				pix[(size_t)j*width + i] = 1;
+		}
+	}
+}
+
+// a stroke of radius r, stamped as overlapping disks
+void PageGenerator::line(double x0, double y0, double x1, double y1, double r) {
+	double len = sqrt((x1-x0)*(x1-x0) + (y1-y0)*(y1-y0));
+	int steps = max(1, (int)ceil(len / max(0.5, r*0.5)));
+	for (int s = 0; s <= steps; ++s) {
+		double t = (double)s / steps;
+		disk(x0 + (x1-x0)*t, y0 + (y1-y0)*t, r);
+	}
+}
+
+double PageGenerator::letter(double x, double baseline, double r) {
+	double slant = params["slant"];
+	int strokes = max(1, (int)round(params["density"] * uniform(1, 3)));
+	double advance = charH * uniform(0.45, 0.65) * max(1.0, strokes / 2.0);
+	for (int s = 0; s < strokes; ++s) {
+		double sx = x + advance * s / strokes;
+		double kind = uniform(0, 1);
+		if (kind < 0.45) {
+			// small letter stroke
+			line(sx, baseline, sx + slant*charH, baseline - charH, r);
+		}
+		else if (kind < 0.6) {
+			// ascender
+			double h = charH * uniform(1.5, 1.8);
+			line(sx, baseline, sx + slant*h, baseline - h, r);
+		}
+		else if (kind < 0.7) {
+			// descender
+			double d = charH * uniform(0.5, 0.8);
+			line(sx - slant*d, baseline + d, sx + slant*charH, baseline - charH, r);
+		}
+		else {
+			// loop, a slanted ellipse of the small letter height
+			double rx = charH * uniform(0.18, 0.28), ry = charH / 2;
+			double cx = sx + rx, cy = baseline - ry;
+			int segs = 16;
+			for (int k = 0; k < segs; ++k) {
+				double a0 = 2*M_PI*k/segs, a1 = 2*M_PI*(k+1)/segs;
+				double y0 = cy + ry*sin(a0), y1 = cy + ry*sin(a1);
+				line(cx + rx*cos(a0) + slant*(baseline-y0), y0, cx + rx*cos(a1) + slant*(baseline-y1), y1, r);
+			}
+		}
+	}
+	// dot of an i or j
+	if (uniform(0, 1) < 0.08)
+		disk(x + slant*charH*1.5, baseline - charH*1.5, r*1.3);
+	return x + advance;
+}
+
+// words of connected letters, the baseline drifts and waves a little
+void PageGenerator::textLine(double baseline) {
+	double margin = params["margin"] * params["dpi"];
+	double r = params["stroke"] * charH / 2;
+	double skew = uniform(-0.01, 0.01), wave = charH * uniform(0, 0.15), phase = uniform(0, 2*M_PI);
+	double x = margin + uniform(0, charH);
+	while (true) {
+		int letters = uniformInt(2, 8);
+		double wordEnd = x + letters * charH * 0.6;
+		if (wordEnd + fabs(params["slant"])*charH*1.8 > width - margin)
+			break;
+		for (int l = 0; l < letters; ++l) {
+			double b = baseline + skew*(x-margin) + wave*sin(x/(charH*6) + phase);
+			double next = letter(x, b, r);
+			// ligature to the next letter along the baseline
+			if (l+1 < letters)
+				line(next - charH*0.1, b, next + charH*0.05, b, r);
+			x = next + charH*0.05;
+		}
+		x += charH * uniform(0.7, 1.5);
+	}
+	if (params["ruling"] != 0) {
+		int y = (int)round(baseline + charH*0.3);
+		for (int i = (int)(margin/2); i < width - margin/2 && y >= 0 && y < height; ++i)
+			pix[(size_t)y*width + i] = 1;
+	}
+}
+
+// dark bands with a ragged inner edge, like the edges of a scanned book page
+void PageGenerator::border() {
+	double w0 = 0.12 * params["dpi"];
+	double phaseL = uniform(0, 2*M_PI), phaseR = uniform(0, 2*M_PI);
+	for (int y = 0; y < height; ++y) {
+		int left = (int)(w0 + w0*0.2*sin(y/(w0*3) + phaseL) + uniform(0, 2));
+		int right = (int)(w0 + w0*0.2*sin(y/(w0*3) + phaseR) + uniform(0, 2));
+		for (int x = 0; x < min(left, width); ++x)
+			pix[(size_t)y*width + x] = 1;
+		for (int x = max(0, width - right); x < width; ++x)
+			pix[(size_t)y*width + x] = 1;
+	}
+}
+
+void PageGenerator::noise() {
+	long specks = (long)(params["noise"] * width * height / 10000);
+	for (long i = 0; i < specks; ++i) {
+		double x = uniform(0, width), y = uniform(0, height);
+		disk(x, y, uniform(0.3, 1.5));
+	}
+}
+
+void PageGenerator::checkerboard() {
+	for (int y = 0; y < height; ++y) {
+		for (int x = y % 2; x < width; x += 2)
+			pix[(size_t)y*width + x] = 1;
+	}
+}
+
+// stroke-wide lines across the page a char_height apart, joined at alternate ends: the longest flood fill path a page can hold
+void PageGenerator::serpentine() {
+	double margin = params["margin"] * params["dpi"];
+	double r = params["stroke"] * charH / 2;
+	double xl = margin, xh = width - 1 - margin;
+	double prev = -1;
+	for (double y = margin; y < height - margin; y += charH) {
+		line(xl, y, xh, y, r);
+		if (prev >= 0) {
+			double x = (((int)((y - margin) / charH)) % 2) ? xh : xl;
+			line(x, prev, x, y, r);
+		}
+		prev = y;
+	}
+}
+
+bool PageGenerator::write(const string &fileName) {
+	clear();
+	int pattern = (int)params["pattern"];
+	if (pattern == 1) {
+		pix.assign(pix.size(), 1);
+		return writeBMP(fileName);
+	}
+	if (pattern == 2) {
+		checkerboard();
+		return writeBMP(fileName);
+	}
+	if (pattern == 3 || pattern == 4) {
+		if (pattern == 3)
+			serpentine();
+		if (params["border"] != 0)
+			border();
+		noise();
+		return writeBMP(fileName);
+	}
+	double margin = params["margin"] * params["dpi"];
+	double spacing = params["line_spacing"] * charH;
+	double top = margin + charH * 1.8;
+	int lines = (int)params["lines"];
+	if (lines <= 0)
+		lines = max(1, (int)((height - margin - top) / spacing) + 1);
+	for (int l = 0; l < lines; ++l) {
+		double baseline = top + l * spacing;
+		if (baseline + charH > height)
+			break;
+		textLine(baseline);
+	}
+	if (params["border"] != 0)
+		border();
+	noise();
+	return writeBMP(fileName);
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	for (int i = 0; i < 4; ++i)
+		p[i] = (v >> (8*i)) & 0xff;
+}
+
+// 1-bit BMP as readOneBitBMP reads it: bit 1 is white, rows from bottom to top, aligned on 4 bytes
+bool PageGenerator::writeBMP(const string &fileName) const {
+	uint32_t lineSize = (width + 31) / 32 * 4;
+	uint32_t dataSize = lineSize * height;
+	uint8_t header[62];
+	memset(header, 0, sizeof(header));
+	header[0] = 'B';
+	header[1] = 'M';
+	put32(header + 2, sizeof(header) + dataSize);
+	put32(header + 10, sizeof(header));
+	put32(header + 14, 40);
+	put32(header + 18, width);
+	put32(header + 22, height);
+	put16(header + 26, 1);
+	put16(header + 28, 1);
+	put32(header + 34, dataSize);
+	uint32_t ppm = (uint32_t)round(params.at("dpi") / 0.0254);
+	put32(header + 38, ppm);
+	put32(header + 42, ppm);
+	put32(header + 46, 2);
+	// palette: 0 black, 1 white
+	header[58] = header[59] = header[60] = 0xff;
+
+	vector<uint8_t> data(dataSize, 0);
+	for (int y = 0; y < height; ++y) {
+		uint8_t *row = &data[(size_t)(height-1-y) * lineSize];
+		for (int x = 0; x < width; ++x) {
+			if (pix[(size_t)y*width + x] == 0)
+				row[x/8] |= 0x80 >> (x%8);
+		}
+	}
+	FILE *f = fopen(fileName.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) && fwrite(data.data(), 1, dataSize, f) == dataSize;
+	return (fclose(f) == 0) && ok;
+}
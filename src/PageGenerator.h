@@ -0,0 +1,66 @@
+#ifndef __PAGEGENERATOR_H__
+#define __PAGEGENERATOR_H__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <random>
+using std::map;
+using std::string;
+using std::vector;
+
+// synthetic handwritten pages as 1-bit BMPs, for benchmarks and tests without real scans
+// text lines of words of slanted strokes, loops and ligatures, with scan borders, ruled lines and speckle noise.
+// the same parameters and seed always give the same page, on any platform
+class PageGenerator {
+public:
+	// parameters, lengths in inches unless noted, see PageGenerator.cpp for the defaults
+	//   seed          random seed
+	//   dpi           resolution
+	//   page_width, page_height, margin
+	//   char_height   height of small letters
+	//   lines         number of text lines, 0: as many as fit
+	//   line_spacing  baseline to baseline, unit char_height
+	//   slant         tangent of the slant of the strokes, positive leans right
+	//   density       stroke density, 1: about two strokes per letter, higher values add strokes and loops
+	//   stroke        stroke width, unit char_height
+	//   border        1: dark scan borders along the left and right edge
+	//   ruling        1: a ruled line under every text line
+	//   noise         specks per 10000 pixels
+	//   pattern       0: handwriting, stress patterns for worst-case time and memory: 1: solid black, 2: checkerboard of single pixels,
+	//                 3: one giant component, a serpentine of text strokes across the page, 4: empty, no text
+	static map<string, double> defaults();
+	// params: overrides of the defaults, unknown names are an error
+	PageGenerator(const map<string, double> &params);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// draw the page, return false if the file cannot be written
+	bool write(const string &fileName);
+
+private:
+	// random numbers from the raw mt19937 output, the standard distributions differ between libraries
+	double uniform(double lo, double hi) { return lo + (hi - lo) * (rng() / 4294967296.0); }
+	int uniformInt(int lo, int hi) { return lo + rng() % (hi - lo + 1); }
+
+	void clear();
+	void disk(double x, double y, double r);
+	void line(double x0, double y0, double x1, double y1, double r);
+	// x advances along the baseline, returns the x after the letter
+	double letter(double x, double baseline, double r);
+	void textLine(double baseline);
+	void border();
+	void noise();
+	void checkerboard();
+	void serpentine();
+	bool writeBMP(const string &fileName) const;
+
+	map<string, double> params;
+	std::mt19937 rng;
+	int width, height;
+	double charH;
+	vector<uint8_t> pix;  // width*height, row by row, 1: black
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <memory>
+#include <functional>
+#include "PageProcessor.h"
+#include "StageCache.h"
+#include "MsgPrint.h"
+
+using std::function;
+
+void segmentLines(HandwrittenImage &img, const PageJob &job, const map<string, double> &configs, StageProfile *profile) {
+	img.setTileMemoryBudget(configs.at("tile_memory_budget"));
+
+	// with the stage cache on, stages whose checkpoint is still valid are restored instead of run
+	std::unique_ptr<StageCache> cache;
+	int restored = 0;
+	if (configs.at("stage_cache") != 0) {
+		StageProfile::Scope scope(profile, "restoreCheckpoints");
+		cache.reset(new StageCache(job.outdir + job.prefix + "_stages", job.image.c_str(), configs,
+				configs.at("tile_memory_budget") > 0, img.getOutputTypes()));
+		restored = cache->restore(img);
+	}
+	auto runStages = [&](HandwrittenImage::CHECKPOINT ckpt, const function<void()> &stages) {
+		if (ckpt < restored)
+			return;
+		stages();
+		if (cache) {
+			StageProfile::Scope scope(profile, "saveCheckpoint");
+			cache->save(img, ckpt);
+		}
+	};
+	// one stage, timed if profiling
+	auto stage = [&](const char *name, const function<void()> &func) {
+		StageProfile::Scope scope(profile, name);
+		func();
+	};
+
+	runStages(HandwrittenImage::CKPT_BORDER, [&] {
+		stage("removeBorder", [&] { img.removeBorder(configs.at("border_removal_horizontal_segment_weight"), configs.at("border_removal_vertial_segment_weight"), configs.at("border_removal_segment_sum_threshold")); });
+	});
+	runStages(HandwrittenImage::CKPT_CHARH, [&] {
+		stage("calcCharHeight", [&] { img.calcCharHeight(configs.at("charH_convergence_diff"), configs.at("charH_cutoff_ratio")); });
+	});
+
+	int charH = img.getCharH();
+	runStages(HandwrittenImage::CKPT_DERIVATIVES, [&] {
+		stage("blur", [&] { img.blur(configs.at("blur_width")*charH, configs.at("blur_height")*charH); });
+		stage("initBlurPixFstOrdParDerivY", [&] { img.initBlurPixFstOrdParDerivY(configs.at("first_order_partial_derivative_of_y_window_height")*charH); });
+		stage("initBlurPixScdOrdParDerivY", [&] { img.initBlurPixScdOrdParDerivY(configs.at("second_order_partial_derivative_of_y_window_height")*charH); });
+	});
+	runStages(HandwrittenImage::CKPT_REGIONS, [&] {
+		stage("initSpaceTracingSeeds", [&] { img.initSpaceTracingSeeds(configs.at("space_tracing_seeds_distance")*charH, configs.at("space_tracing_seeds_distance")*charH); });
+		stage("segmentRegions", [&] { img.segmentRegions(); });
+		stage("labelRegions", [&] { img.labelRegions(configs.at("region_area_min")*charH*charH, configs.at("region_black_pixel_percentage_min"), configs.at("region_black_pixel_percentage_max")); });
+	});
+	runStages(HandwrittenImage::CKPT_TEXTLINES, [&] {
+		stage("initTextTracingSeeds", [&] { img.initTextTracingSeeds(configs.at("text_tracing_seeds_distance")*charH, configs.at("text_tracing_seeds_distance")*charH); });
+		stage("locateTextLineCenters", [&] { img.locateTextLineCenters(); });
+		stage("assignComponentsToRegions", [&] { img.assignComponentsToRegions(); });
+	});
+	runStages(HandwrittenImage::CKPT_HULLS, [&] {
+		stage("slantCorrection", [&] { img.slantCorrection(); });
+		stage("genConvexHullComponents", [&] { img.genConvexHullComponents(); });
+	});
+}
+
+void extractWords(HandwrittenImage &img, const map<string, double> &configs, StageProfile *profile) {
+	StageProfile::Scope scope(profile, "extractWord");
+	int charH = img.getCharH();
+	img.extractWord(configs.at("word_center_strap_width"), configs.at("word_width_min")*charH, configs.at("word_height_min")*charH,
+			        configs.at("word_gap_threshold")*charH, configs.at("word_alpha"));
+}
+
+void segmentPage(HandwrittenImage &img, const PageJob &job, const map<string, double> &configs, StageProfile *profile) {
+	segmentLines(img, job, configs, profile);
+	extractWords(img, configs, profile);
+}
+
+vector<string> writePageOutputs(const HandwrittenImage &img, const PageJob &job, bool dumpall, StageProfile *profile) {
+	// intermediate images and the suffix of their file names
+	static const struct {
+		HandwrittenImage::PIXTYPE type;
+		const char *suffix;
+	} dumps[] = {
+		//{HandwrittenImage::BINPIX, "_bin.bmp"},
+		{HandwrittenImage::BINPIXBR, "_binBR.bmp"},
+		{HandwrittenImage::CHARH, "_charH.bmp"},
+		{HandwrittenImage::BLURPIX, "_blur.bmp"},
+		{HandwrittenImage::SPACETRACINGSEEDS, "_spaceSeeds.bmp"},
+		{HandwrittenImage::SPACETRACES, "_spaceTraces.bmp"},
+		{HandwrittenImage::REGIONS, "_regions.bmp"},
+		{HandwrittenImage::TEXTTRACINGSEEDS, "_textSeeds.bmp"},
+		{HandwrittenImage::TEXTTRACES, "_textTraces.bmp"},
+		{HandwrittenImage::TEXTLINES, "_textLines.bmp"},
+		{HandwrittenImage::NOSLANT, "_noSlant.bmp"},
+		{HandwrittenImage::CONVEXHULL, "_convexHull.bmp"},
+		{HandwrittenImage::WORDMAP, "_words.bmp"},
+	};
+
+	string base = job.outdir + job.prefix;
+	vector<string> files;
+	{
+		StageProfile::Scope scope(profile, "writeWords");
+		img.writeWords(base.c_str(), &files);
+	}
+
+	if (dumpall) {
+		for (size_t i = 0; i < sizeof(dumps)/sizeof(dumps[0]); ++i) {
+			StageProfile::Scope scope(profile, "writeBMP");
+			files.push_back(base + dumps[i].suffix);
+			img.writeBMP(files.back().c_str(), dumps[i].type);
+		}
+	}
+
+	if (profile != NULL) {
+		profile->setSize(img.getWidth(), img.getHeight(), img.getCharH());
+		if (!profile->writeJSON(base + "_profile.json"))
+			MsgPrint::msgPrint(MsgPrint::WARN, ("Cannot write stage profile " + base + "_profile.json").c_str());
+	}
+	return files;
+}
+
+void readPage(HandwrittenImage &img, const PageJob &job, bool dumpall, StageProfile *profile) {
+	if (profile != NULL) {
+		profile->clear();
+		profile->setPage(job.image, job.prefix);
+	}
+	{
+		StageProfile::Scope scope(profile, "readOneBitBMP");
+		img.setOutputTypes(dumpall ? HandwrittenImage::ALL_OUTPUTS : 0);
+		img.readOneBitBMP(job.image.c_str());
+	}
+	if (profile != NULL)
+		profile->setInkPixels(img.countInkPixels());
+}
+
+void processPage(HandwrittenImage &img, const PageJob &job, const map<string, double> &configs, bool dumpall) {
+	StageProfile profile;
+	StageProfile *p = (configs.at("profile") != 0) ? &profile : NULL;
+	readPage(img, job, dumpall, p);
+	segmentPage(img, job, configs, p);
+	writePageOutputs(img, job, dumpall, p);
+}
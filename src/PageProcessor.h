@@ -0,0 +1,35 @@
+#ifndef __PAGEPROCESSOR_H__
+#define __PAGEPROCESSOR_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "HandwrittenImage.h"
+#include "StageProfile.h"
+using std::map;
+using std::string;
+using std::vector;
+
+// one page to segment
+struct PageJob {
+	string image;   // input image, 1-bit BMP
+	string outdir;  // output directory, ends with '/'
+	string prefix;  // output file name prefix
+};
+
+// profile: if not NULL, the stages are timed, readPage starts a new profile and writePageOutputs writes it to <outdir><prefix>_profile.json
+
+// read the page image, intermediate images are kept for output only if dumpall is set
+void readPage(HandwrittenImage &img, const PageJob &job, bool dumpall, StageProfile *profile = NULL);
+// run all segmentation stages after the image is read, stages are resumed from the page's stage cache if it is enabled
+void segmentPage(HandwrittenImage &img, const PageJob &job, const map<string, double> &configs, StageProfile *profile = NULL);
+// the two parts of segmentPage: all stages up to the convex hull components, and the word extraction
+// extractWords can be run again with other word_* configs on the same components, unless the page is processed in tiles
+void segmentLines(HandwrittenImage &img, const PageJob &job, const map<string, double> &configs, StageProfile *profile = NULL);
+void extractWords(HandwrittenImage &img, const map<string, double> &configs, StageProfile *profile = NULL);
+// write words of a segmented page, and all intermediate images if dumpall is set, return names of the written files
+vector<string> writePageOutputs(const HandwrittenImage &img, const PageJob &job, bool dumpall, StageProfile *profile = NULL);
+// read, segment and write one page
+void processPage(HandwrittenImage &img, const PageJob &job, const map<string, double> &configs, bool dumpall);
+
+#endif
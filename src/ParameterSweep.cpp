@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "ParameterSweep.h"
+#include "HandwrittenImage.h"
+#include "MsgPrint.h"
+
+using std::ifstream;
+using std::istringstream;
+
+// configs read by extractWord
+static const char *WORD_CONFIGS[] = {"word_center_strap_width", "word_width_min", "word_height_min", "word_gap_threshold", "word_alpha"};
+static const int WORD_CONFIG_CNT = sizeof(WORD_CONFIGS) / sizeof(WORD_CONFIGS[0]);
+
+ParameterSweep::ParameterSweep(const char *gridFile, const map<string, double> &configs) {
+	char msg[1000];
+	this->configs = configs;
+	// extractWord runs many times on the same page, the planes it reads must stay
+	this->configs["tile_memory_budget"] = 0;
+
+	ifstream f(gridFile);
+	if (!f.is_open()) {
+		sprintf(msg, "Cannot open sweep grid file %s.", gridFile);
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+	map<string, vector<double> > grid;
+	string line, name;
+	while (getline(f, line)) {
+		istringstream ss(line);
+		if (!(ss >> name) || name[0] == '#')
+			continue;
+		bool known = false;
+		for (int i = 0; i < WORD_CONFIG_CNT; ++i)
+			known = known || (name == WORD_CONFIGS[i]);
+		vector<double> values;
+		double v;
+		while (ss >> v)
+			values.push_back(v);
+		if (!known || values.empty()) {
+			sprintf(msg, "Invalid sweep grid line: %s", line.c_str());
+			MsgPrint::msgPrint(MsgPrint::ERR, msg);
+		}
+		grid[name] = values;
+	}
+
+	// cartesian product, the last config of WORD_CONFIGS varies fastest
+	settings.push_back(map<string, double>());
+	for (int i = 0; i < WORD_CONFIG_CNT; ++i) {
+		vector<double> values = grid.count(WORD_CONFIGS[i]) ? grid[WORD_CONFIGS[i]] : vector<double>(1, configs.at(WORD_CONFIGS[i]));
+		vector< map<string, double> > product;
+		for (size_t s = 0; s < settings.size(); ++s) {
+			for (size_t k = 0; k < values.size(); ++k) {
+				product.push_back(settings[s]);
+				product.back()[WORD_CONFIGS[i]] = values[k];
+			}
+		}
+		settings.swap(product);
+	}
+}
+
+int ParameterSweep::run(const vector<PageJob> &jobs, const char *reportFile, ThreadPool *pool) {
+	char msg[1000];
+	FILE *report = fopen(reportFile, "w");
+	if (report == NULL) {
+		sprintf(msg, "Cannot write sweep report %s.", reportFile);
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+	sprintf(msg, "Sweeping %zu word extraction settings over %zu pages ......", settings.size(), jobs.size());
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+
+	for (size_t s = 0; s < settings.size(); ++s) {
+		fprintf(report, "setting %zu", s+1);
+		for (int i = 0; i < WORD_CONFIG_CNT; ++i)
+			fprintf(report, " %s=%g", WORD_CONFIGS[i], settings[s].at(WORD_CONFIGS[i]));
+		fprintf(report, "\n");
+	}
+
+	// like a batch, a failing page is reported and skipped
+	MsgPrint::setErrAction(MsgPrint::THROW);
+	vector<size_t> totals(settings.size(), 0);
+	int failed = 0;
+	HandwrittenImage img;
+	img.setThreadPool(pool);
+	// the settings share most distances of a page
+	img.setDistanceCache(true);
+	for (size_t p = 0; p < jobs.size(); ++p) {
+		const PageJob &job = jobs[p];
+		MsgPrint::setContext(job.prefix.c_str());
+		try {
+			readPage(img, job, false);
+			segmentLines(img, job, configs);
+			map<string, double> setting = configs;
+			for (size_t s = 0; s < settings.size(); ++s) {
+				for (map<string, double>::const_iterator it = settings[s].begin(); it != settings[s].end(); ++it)
+					setting[it->first] = it->second;
+				extractWords(img, setting);
+
+				const vector<HandwrittenImage::WordBBox> &words = img.getWordBoxes();
+				totals[s] += words.size();
+				fprintf(report, "words %s %zu %zu\n", job.prefix.c_str(), s+1, words.size());
+				for (size_t i = 0; i < words.size(); ++i) {
+					const HandwrittenImage::WordBBox &w = words[i];
+					fprintf(report, "box %s %zu %d %d %d %d %d %d\n", job.prefix.c_str(), s+1, w.regionID, w.wordID,
+							w.xl, w.yl, w.xh-w.xl+1, w.yh-w.yl+1);
+				}
+			}
+		}
+		catch (const std::exception &e) {
+			++failed;
+			sprintf(msg, "Page %s failed: %s", job.image.c_str(), e.what());
+			MsgPrint::setContext(NULL);
+			MsgPrint::msgPrint(MsgPrint::WARN, msg);
+		}
+		MsgPrint::setContext(NULL);
+	}
+	MsgPrint::setErrAction(MsgPrint::EXIT);
+
+	for (size_t s = 0; s < settings.size(); ++s)
+		fprintf(report, "total %zu %zu\n", s+1, totals[s]);
+	if (fclose(report) != 0) {
+		sprintf(msg, "Cannot write sweep report %s.", reportFile);
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+	sprintf(msg, "Swept %zu pages, %d failed.", jobs.size(), failed);
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+	return failed;
+}
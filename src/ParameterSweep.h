@@ -0,0 +1,35 @@
+#ifndef __PARAMETERSWEEP_H__
+#define __PARAMETERSWEEP_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "PageProcessor.h"
+using std::map;
+using std::string;
+using std::vector;
+
+class ThreadPool;
+
+// evaluate a grid of word extraction settings on a set of pages
+// every page is segmented once up to its convex hull components, then extractWord runs once per setting
+// on the same components, so distances between components are calculated only once per page
+class ParameterSweep {
+public:
+	// grid: one word_* config per line, "<name> <value> [<value> ...]", the grid is the cartesian product of the lines
+	// configs not in the grid keep their value in configs. empty lines and lines starting with '#' are skipped
+	ParameterSweep(const char *gridFile, const map<string, double> &configs);
+	// report, one line per record:
+	//   setting <setting> <name>=<value> ...          the settings, numbered from 1
+	//   words <prefix> <setting> <count>              number of words of a page
+	//   box <prefix> <setting> <line> <word> <x> <y> <width> <height>
+	//   total <setting> <count>                       number of words of all pages
+	// return the number of failed pages
+	int run(const vector<PageJob> &jobs, const char *reportFile, ThreadPool *pool);
+
+private:
+	map<string, double> configs;
+	vector< map<string, double> > settings;  // word_* configs of each setting
+};
+
+#endif
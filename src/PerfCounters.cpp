@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "PerfCounters.h"
+#include "MsgPrint.h"
+
+using std::string;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+static const uint64_t EVENT_CONFIGS[PerfCounters::EVENT_COUNT] = {
+	PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static const char *EVENT_NAMES[PerfCounters::EVENT_COUNT] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+
+bool PerfCounters::on = false;
+int PerfCounters::index[PerfCounters::EVENT_COUNT] = {-1, -1, -1, -1};
+int PerfCounters::eventCnt = 0;
+
+// counters stay open after their threads exit, a group keeps the final counts of its thread
+static mutex groupsMtx;
+static vector<int> groups;  // group leader of every attached thread
+static thread_local bool attached = false;
+
+// user space only, perf_event_paranoid 2 still permits counting the own threads
+static int openEvent(uint64_t config, int groupFd) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+bool PerfCounters::enable() {
+	if (on)
+		return true;
+	// find the events this machine counts, in the calling thread, the first one leads the group
+	int leader = -1;
+	string error;
+	for (int e = 0; e < EVENT_COUNT; ++e) {
+		int fd = openEvent(EVENT_CONFIGS[e], leader);
+		if (fd < 0) {
+			if (error.empty())
+				error = strerror(errno);
+			continue;
+		}
+		if (leader < 0)
+			leader = fd;
+		index[e] = eventCnt++;
+	}
+	if (leader < 0) {
+		MsgPrint::msgPrint(MsgPrint::WARN, ("Hardware performance counters are unavailable: " + error).c_str());
+		return false;
+	}
+	groups.push_back(leader);
+	attached = true;
+	on = true;
+	return true;
+}
+
+void PerfCounters::attachThread() {
+	if (!on || attached)
+		return;
+	attached = true;
+	// the same events as the first thread, so every group reads the same layout
+	vector<int> fds;
+	for (int e = 0; e < EVENT_COUNT; ++e) {
+		if (index[e] < 0)
+			continue;
+		int fd = openEvent(EVENT_CONFIGS[e], fds.empty() ? -1 : fds[0]);
+		if (fd < 0) {
+			for (size_t i = 0; i < fds.size(); ++i)
+				close(fds[i]);
+			return;
+		}
+		fds.push_back(fd);
+	}
+	lock_guard<mutex> lock(groupsMtx);
+	groups.push_back(fds[0]);
+}
+
+void PerfCounters::read(uint64_t values[EVENT_COUNT]) {
+	for (int e = 0; e < EVENT_COUNT; ++e)
+		values[e] = 0;
+	if (!on)
+		return;
+	// nr, time enabled, time running, one value per event
+	vector<uint64_t> buf(3 + eventCnt);
+	double sums[EVENT_COUNT] = {0};
+	lock_guard<mutex> lock(groupsMtx);
+	for (size_t g = 0; g < groups.size(); ++g) {
+		ssize_t len = ::read(groups[g], buf.data(), buf.size() * sizeof(uint64_t));
+		if (len != (ssize_t)(buf.size() * sizeof(uint64_t)) || buf[2] == 0)
+			continue;
+		double scale = (double)buf[1] / buf[2];
+		for (int e = 0; e < EVENT_COUNT; ++e) {
+			if (index[e] >= 0)
+				sums[e] += buf[3 + index[e]] * scale;
+		}
+	}
+	for (int e = 0; e < EVENT_COUNT; ++e)
+		values[e] = sums[e];
+}
+
+const char *PerfCounters::name(EVENT event) {
+	return EVENT_NAMES[event];
+}
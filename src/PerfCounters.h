@@ -0,0 +1,32 @@
+#ifndef __PERFCOUNTERS_H__
+#define __PERFCOUNTERS_H__
+
+#include <cstdint>
+
+// hardware performance counters of the process, read with perf_event_open
+// every thread that works on pages opens its own counters, a reading is the sum over all of them.
+// counters the kernel multiplexes are scaled by the time they were running.
+// where perf_event_open is not permitted (perf_event_paranoid, containers, VMs) enable fails and nothing is counted
+class PerfCounters {
+public:
+	enum EVENT {CYCLES, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, EVENT_COUNT};
+
+	// open counters for the calling thread, must be called before the threads to be counted start
+	// return false if no counter is available, a warning tells why
+	static bool enable();
+	static bool enabled() { return on; }
+	// whether the event is counted, some CPUs and hypervisors do not provide every event
+	static bool available(EVENT event) { return on && index[event] >= 0; }
+	// open counters for the calling thread, nothing if counters are disabled or already open for it
+	static void attachThread();
+	// sum of the counters of all attached threads, including threads that have exited
+	static void read(uint64_t values[EVENT_COUNT]);
+	static const char *name(EVENT event);
+
+private:
+	static bool on;
+	static int index[EVENT_COUNT];  // position of each event in a group read, -1: not available
+	static int eventCnt;
+};
+
+#endif
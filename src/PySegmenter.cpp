@@ -0,0 +1,451 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <cstdio>
+#include <climits>
+#include <new>
+#include <exception>
+#include "Segmenter.h"
+#include "ConfigParser.h"
+#include "MsgPrint.h"
+
+// Python bindings of Segmenter.h, built as the module segmenter by make python
+//
+//   seg = segmenter.Segmenter(config=None, **configs)   config: path of a config file like default.config
+//   result = seg.segment(pixels, width=None, height=None, gray=False, masks=0)
+//
+// pixels is any object with the buffer protocol of one byte per pixel (a numpy uint8 array, bytes, bytearray,
+// memoryview), 2-D as rows x columns with its rows any stride apart, or 1-D of height rows of width bytes.
+// It is read in place, not copied. The result's lines, words and masks are memoryviews of int32 over the
+// memory the engine wrote them to, numpy.asarray() of them does not copy either.
+// segment() releases the GIL while the page is segmented, pages of different Segmenters segment concurrently.
+
+static PyObject *SegmenterError;
+
+static const char *LINE_FIELDS[] = {"line_id", "xl", "xh", "yl", "yh", "first_word", "word_count"};
+static const char *WORD_FIELDS[] = {"word_id", "line_id", "xl", "xh", "yl", "yh"};
+static_assert(sizeof(Segmenter::Line) == sizeof(LINE_FIELDS) / sizeof(char *) * sizeof(int), "Line is not an int row");
+static_assert(sizeof(Segmenter::Word) == sizeof(WORD_FIELDS) / sizeof(char *) * sizeof(int), "Word is not an int row");
+
+// the C++ result of one page, kept alive by the views over it
+struct ResultObject {
+	PyObject_HEAD
+	Segmenter::Result result;
+	PyObject *lines, *words, *lineMask, *wordMask;  // memoryviews, made on first access
+};
+
+// exports one 2-D int32 table of a result to a memoryview
+struct TableObject {
+	PyObject_HEAD
+	ResultObject *owner;
+	int32_t *data;
+	Py_ssize_t shape[2], strides[2];
+};
+
+static PyTypeObject TableType = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject ResultType = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject SegmenterType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static void tableDealloc(TableObject *self) {
+	Py_XDECREF(self->owner);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int tableGetBuffer(TableObject *self, Py_buffer *view, int flags) {
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "Segmentation results are read-only");
+		return -1;
+	}
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = self->data;
+	view->len = self->shape[0] * self->shape[1] * sizeof(int32_t);
+	view->readonly = 1;
+	view->itemsize = sizeof(int32_t);
+	view->format = (flags & PyBUF_FORMAT) ? (char *)"i" : NULL;
+	view->ndim = 2;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static PyBufferProcs tableBufferProcs = {(getbufferproc)tableGetBuffer, NULL};
+
+// a memoryview of rows x cols int32 at data, NULL with an exception set on failure
+static PyObject *makeView(ResultObject *owner, const int32_t *data, Py_ssize_t rows, Py_ssize_t cols) {
+	static int32_t empty = 0;
+	TableObject *table = PyObject_New(TableObject, &TableType);
+	if (table == NULL)
+		return NULL;
+	Py_INCREF(owner);
+	table->owner = owner;
+	table->data = (data != NULL) ? (int32_t *)data : &empty;
+	table->shape[0] = rows;
+	table->shape[1] = cols;
+	table->strides[0] = cols * sizeof(int32_t);
+	table->strides[1] = sizeof(int32_t);
+	PyObject *view = PyMemoryView_FromObject((PyObject *)table);
+	Py_DECREF(table);
+	return view;
+}
+
+static void resultDealloc(ResultObject *self) {
+	Py_XDECREF(self->lines);
+	Py_XDECREF(self->words);
+	Py_XDECREF(self->lineMask);
+	Py_XDECREF(self->wordMask);
+	self->result.~Result();
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *resultNew() {
+	ResultObject *self = PyObject_New(ResultObject, &ResultType);
+	if (self == NULL)
+		return NULL;
+	new (&self->result) Segmenter::Result();
+	self->lines = self->words = self->lineMask = self->wordMask = NULL;
+	return (PyObject *)self;
+}
+
+// which: 0 lines, 1 words, 2 line mask, 3 word mask
+static PyObject *resultGetTable(ResultObject *self, void *closure) {
+	long which = (long)closure;
+	const Segmenter::Result &r = self->result;
+	PyObject **cached[] = {&self->lines, &self->words, &self->lineMask, &self->wordMask};
+	if (*cached[which] == NULL) {
+		if (which == 0)
+			*cached[which] = makeView(self, (const int32_t *)r.lines.data(), r.lines.size(), sizeof(LINE_FIELDS) / sizeof(char *));
+		else if (which == 1)
+			*cached[which] = makeView(self, (const int32_t *)r.words.data(), r.words.size(), sizeof(WORD_FIELDS) / sizeof(char *));
+		else {
+			const vector<int32_t> &mask = (which == 2) ? r.lineMask : r.wordMask;
+			if (mask.empty())
+				Py_RETURN_NONE;
+			*cached[which] = makeView(self, mask.data(), r.height, r.width);
+		}
+		if (*cached[which] == NULL)
+			return NULL;
+	}
+	Py_INCREF(*cached[which]);
+	return *cached[which];
+}
+
+static PyObject *resultGetInt(ResultObject *self, void *closure) {
+	const Segmenter::Result &r = self->result;
+	long which = (long)closure;
+	return PyLong_FromLong((which == 0) ? r.width : (which == 1) ? r.height : r.charH);
+}
+
+static PyGetSetDef resultGetSet[] = {
+	{"width", (getter)resultGetInt, NULL, "page width in pixels", (void *)0},
+	{"height", (getter)resultGetInt, NULL, "page height in pixels", (void *)1},
+	{"char_height", (getter)resultGetInt, NULL, "average character height in pixels", (void *)2},
+	{"lines", (getter)resultGetTable, NULL, "int32 rows of LINE_FIELDS, lines holding words", (void *)0},
+	{"words", (getter)resultGetTable, NULL, "int32 rows of WORD_FIELDS, line by line, left to right", (void *)1},
+	{"line_mask", (getter)resultGetTable, NULL, "height x width int32 line IDs, None unless requested", (void *)2},
+	{"word_mask", (getter)resultGetTable, NULL, "height x width int32 word IDs, None unless requested", (void *)3},
+	{NULL}
+};
+
+struct SegmenterObject {
+	PyObject_HEAD
+	Segmenter *seg;
+	bool busy;  // a page is being segmented with the GIL released
+};
+
+// false with an exception set if the Segmenter cannot take a call now
+static bool ready(SegmenterObject *self) {
+	if (self->seg == NULL)
+		PyErr_SetString(PyExc_RuntimeError, "Segmenter is not initialized");
+	else if (self->busy)
+		PyErr_SetString(PyExc_RuntimeError, "Segmenter is segmenting another page, use one Segmenter per thread");
+	return self->seg != NULL && !self->busy;
+}
+
+// raise the exception of a failed Segmenter call, return NULL
+static PyObject *raiseStatus(Segmenter::STATUS status, const string &msg) {
+	PyObject *type = (status == Segmenter::INVALID_ARGUMENT) ? PyExc_ValueError :
+			(status == Segmenter::UNKNOWN_CONFIG) ? PyExc_KeyError :
+			(status == Segmenter::OUT_OF_MEMORY) ? PyExc_MemoryError : SegmenterError;
+	PyErr_SetString(type, msg.c_str());
+	return NULL;
+}
+
+static PyObject *segmenterSetConfigs(SegmenterObject *self, PyObject *configs);
+static int initSegmenter(SegmenterObject *self, const char *config);
+
+static int segmenterInit(SegmenterObject *self, PyObject *args, PyObject *kwargs) {
+	const char *config = NULL;
+	if (!PyArg_ParseTuple(args, "|z:Segmenter", &config))
+		return -1;
+	// config is the file, every other keyword a config
+	PyObject *configs = (kwargs != NULL) ? PyDict_Copy(kwargs) : PyDict_New();
+	if (configs == NULL)
+		return -1;
+	PyObject *file = PyDict_GetItemString(configs, "config");
+	if (file != NULL) {
+		if (config != NULL || (file != Py_None && !PyUnicode_Check(file))) {
+			Py_DECREF(configs);
+			PyErr_SetString(PyExc_TypeError, "config must be given once, as the path of a config file");
+			return -1;
+		}
+		config = (file != Py_None) ? PyUnicode_AsUTF8(file) : NULL;
+	}
+	int status = initSegmenter(self, config);
+	if (status == 0 && file != NULL)
+		status = PyDict_DelItemString(configs, "config");
+	PyObject *ok = (status == 0) ? segmenterSetConfigs(self, configs) : NULL;
+	Py_DECREF(configs);
+	Py_XDECREF(ok);
+	return (ok != NULL) ? 0 : -1;
+}
+
+static int initSegmenter(SegmenterObject *self, const char *config) {
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError, "Segmenter is segmenting another page");
+		return -1;
+	}
+	try {
+		delete self->seg;
+		self->seg = NULL;
+		self->seg = new Segmenter();
+		if (config != NULL) {
+			FILE *f = fopen(config, "r");
+			if (f == NULL) {
+				PyErr_Format(PyExc_OSError, "Cannot open config file %s", config);
+				return -1;
+			}
+			fclose(f);
+			map<string, double> configs = ConfigParser(config).getConfigs();
+			for (map<string, double>::iterator it = configs.begin(); it != configs.end(); ++it)
+				self->seg->setConfig(it->first, it->second);
+		}
+	}
+	catch (const MsgPrint::Error &e) {
+		PyErr_SetString(SegmenterError, e.what());
+		return -1;
+	}
+	catch (const std::bad_alloc &) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	catch (const std::exception &e) {
+		PyErr_SetString(SegmenterError, e.what());
+		return -1;
+	}
+	return 0;
+}
+
+static void segmenterDealloc(SegmenterObject *self) {
+	delete self->seg;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *segmenterSetConfigs(SegmenterObject *self, PyObject *configs) {
+	PyObject *key, *value;
+	Py_ssize_t pos = 0;
+	while (PyDict_Next(configs, &pos, &key, &value)) {
+		const char *name = PyUnicode_AsUTF8(key);
+		double v = PyFloat_AsDouble(value);
+		if (name == NULL || (v == -1 && PyErr_Occurred()))
+			return NULL;
+		Segmenter::STATUS status = self->seg->setConfig(name, v);
+		if (status != Segmenter::OK)
+			return raiseStatus(status, self->seg->getError());
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *segmenterSetConfig(SegmenterObject *self, PyObject *args, PyObject *kwargs) {
+	if (PyTuple_GET_SIZE(args) != 0) {
+		PyErr_SetString(PyExc_TypeError, "set_config takes configs as keyword arguments");
+		return NULL;
+	}
+	if (!ready(self))
+		return NULL;
+	return (kwargs == NULL) ? (Py_INCREF(Py_None), Py_None) : segmenterSetConfigs(self, kwargs);
+}
+
+static PyObject *segmenterConfigs(SegmenterObject *self, PyObject *) {
+	if (!ready(self))
+		return NULL;
+	PyObject *dict = PyDict_New();
+	const map<string, double> &configs = self->seg->getConfigs();
+	for (map<string, double>::const_iterator it = configs.begin(); dict != NULL && it != configs.end(); ++it) {
+		PyObject *v = PyFloat_FromDouble(it->second);
+		if (v == NULL || PyDict_SetItemString(dict, it->first.c_str(), v) != 0)
+			Py_CLEAR(dict);
+		Py_XDECREF(v);
+	}
+	return dict;
+}
+
+static PyObject *segmenterSetGrayThreshold(SegmenterObject *self, PyObject *args) {
+	int threshold;
+	if (!PyArg_ParseTuple(args, "i:set_gray_threshold", &threshold) || !ready(self))
+		return NULL;
+	self->seg->setGrayThreshold(threshold);
+	Py_RETURN_NONE;
+}
+
+static PyObject *segmenterSegment(SegmenterObject *self, PyObject *args, PyObject *kwargs) {
+	static const char *keywords[] = {"pixels", "width", "height", "gray", "masks", NULL};
+	PyObject *pixels;
+	int width = -1, height = -1, gray = 0;
+	unsigned int masks = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iipI:segment", (char **)keywords, &pixels, &width, &height, &gray, &masks))
+		return NULL;
+	if (!ready(self))
+		return NULL;
+
+	Py_buffer buf;
+	if (PyObject_GetBuffer(pixels, &buf, PyBUF_RECORDS_RO) != 0)
+		return NULL;
+	// one byte per pixel, the bytes of a row next to each other
+	Py_ssize_t stride = 0;
+	const char *error = NULL;
+	if (buf.itemsize != 1)
+		error = "pixels must have one byte per pixel";
+	else if (buf.ndim == 2) {
+		if (buf.strides[1] != 1 || buf.strides[0] < buf.shape[1])
+			error = "pixels must have the bytes of a row next to each other";
+		else if (buf.shape[0] > INT_MAX || buf.strides[0] > INT_MAX)
+			error = "pixels are too large";
+		else if ((width != -1 && width != buf.shape[1]) || (height != -1 && height != buf.shape[0]))
+			error = "width and height differ from the shape of pixels";
+		width = buf.shape[1];
+		height = buf.shape[0];
+		stride = buf.strides[0];
+	}
+	else if (buf.ndim == 1) {
+		if (width <= 0 || height <= 0 || buf.strides[0] != 1 || buf.len < (Py_ssize_t)width * height)
+			error = "1-D pixels need width and height, and width*height contiguous bytes";
+		stride = width;
+	}
+	else
+		error = "pixels must be 1-D or 2-D";
+	if (error != NULL) {
+		PyBuffer_Release(&buf);
+		PyErr_SetString(PyExc_ValueError, error);
+		return NULL;
+	}
+
+	ResultObject *result = (ResultObject *)resultNew();
+	if (result == NULL) {
+		PyBuffer_Release(&buf);
+		return NULL;
+	}
+	Segmenter::STATUS status;
+	self->busy = true;
+	string message;
+	Py_BEGIN_ALLOW_THREADS
+	// no C++ exception may leave into the interpreter
+	try {
+		status = self->seg->segment((const uint8_t *)buf.buf, width, height, stride,
+				gray ? Segmenter::GRAY : Segmenter::BINARY, masks, result->result);
+		if (status != Segmenter::OK)
+			message = self->seg->getError();
+	}
+	catch (const std::bad_alloc &) {
+		status = Segmenter::OUT_OF_MEMORY;
+		message = "Out of memory";
+	}
+	catch (const std::exception &e) {
+		status = Segmenter::SEGMENTATION_FAILED;
+		message = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	self->busy = false;
+	PyBuffer_Release(&buf);
+	if (status != Segmenter::OK) {
+		Py_DECREF(result);
+		return raiseStatus(status, message);
+	}
+	return (PyObject *)result;
+}
+
+static PyMethodDef segmenterMethods[] = {
+	{"segment", (PyCFunction)(void (*)(void))segmenterSegment, METH_VARARGS | METH_KEYWORDS,
+		"segment(pixels, width=None, height=None, gray=False, masks=0) -> Result\n"
+		"masks: LINE_MASK | WORD_MASK, the label planes to return"},
+	{"set_config", (PyCFunction)(void (*)(void))segmenterSetConfig, METH_VARARGS | METH_KEYWORDS,
+		"set_config(**configs), configs named as in default.config"},
+	{"configs", (PyCFunction)segmenterConfigs, METH_NOARGS, "configs() -> dict of every config"},
+	{"set_gray_threshold", (PyCFunction)segmenterSetGrayThreshold, METH_VARARGS,
+		"set_gray_threshold(threshold), gray level below which a pixel is black, 128 by default"},
+	{NULL}
+};
+
+static PyObject *setLogLevel(PyObject *, PyObject *args) {
+	int level;
+	if (!PyArg_ParseTuple(args, "i:set_log_level", &level))
+		return NULL;
+	Segmenter::setLogLevel(level);
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef moduleMethods[] = {
+	{"set_log_level", setLogLevel, METH_VARARGS, "set_log_level(level), 0: errors, 1: warnings, 2: progress (default)"},
+	{NULL}
+};
+
+static PyModuleDef moduleDef = {PyModuleDef_HEAD_INIT, "segmenter",
+		"Segmentation of handwritten pages into lines and words, pages are read from buffers in place", -1, moduleMethods};
+
+static PyObject *fieldNames(const char **fields, size_t n) {
+	PyObject *t = PyTuple_New(n);
+	for (size_t i = 0; t != NULL && i < n; ++i) {
+		PyObject *s = PyUnicode_FromString(fields[i]);
+		if (s == NULL)
+			Py_CLEAR(t);
+		else
+			PyTuple_SET_ITEM(t, i, s);
+	}
+	return t;
+}
+
+PyMODINIT_FUNC PyInit_segmenter(void) {
+	TableType.tp_name = "segmenter._Table";
+	TableType.tp_basicsize = sizeof(TableObject);
+	TableType.tp_flags = Py_TPFLAGS_DEFAULT;
+	TableType.tp_dealloc = (destructor)tableDealloc;
+	TableType.tp_as_buffer = &tableBufferProcs;
+
+	ResultType.tp_name = "segmenter.Result";
+	ResultType.tp_basicsize = sizeof(ResultObject);
+	ResultType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ResultType.tp_doc = "Lines, words and label planes of a page, in the coordinates of the slant corrected page";
+	ResultType.tp_dealloc = (destructor)resultDealloc;
+	ResultType.tp_getset = resultGetSet;
+
+	SegmenterType.tp_name = "segmenter.Segmenter";
+	SegmenterType.tp_basicsize = sizeof(SegmenterObject);
+	SegmenterType.tp_flags = Py_TPFLAGS_DEFAULT;
+	SegmenterType.tp_doc = "Segmenter(config=None, **configs), the built-in default configs, then those of the config file, then configs\n"
+			"segments one page at a time, keeping its thread pool and planes from page to page";
+	SegmenterType.tp_new = PyType_GenericNew;
+	SegmenterType.tp_init = (initproc)segmenterInit;
+	SegmenterType.tp_dealloc = (destructor)segmenterDealloc;
+	SegmenterType.tp_methods = segmenterMethods;
+
+	if (PyType_Ready(&TableType) < 0 || PyType_Ready(&ResultType) < 0 || PyType_Ready(&SegmenterType) < 0)
+		return NULL;
+	PyObject *m = PyModule_Create(&moduleDef);
+	if (m == NULL)
+		return NULL;
+	SegmenterError = PyErr_NewException("segmenter.Error", NULL, NULL);
+	Py_INCREF(&SegmenterType);
+	Py_INCREF(&ResultType);
+	if (SegmenterError == NULL || PyModule_AddObject(m, "Error", SegmenterError) < 0
+			|| PyModule_AddObject(m, "Segmenter", (PyObject *)&SegmenterType) < 0
+			|| PyModule_AddObject(m, "Result", (PyObject *)&ResultType) < 0
+			|| PyModule_AddIntConstant(m, "LINE_MASK", Segmenter::LINE_MASK) < 0
+			|| PyModule_AddIntConstant(m, "WORD_MASK", Segmenter::WORD_MASK) < 0
+			|| PyModule_AddObject(m, "LINE_FIELDS", fieldNames(LINE_FIELDS, sizeof(LINE_FIELDS) / sizeof(char *))) < 0
+			|| PyModule_AddObject(m, "WORD_FIELDS", fieldNames(WORD_FIELDS, sizeof(WORD_FIELDS) / sizeof(char *))) < 0) {
+		Py_DECREF(m);
+		return NULL;
+	}
+	return m;
+}
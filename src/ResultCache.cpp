@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <sys/stat.h>
+#include "ResultCache.h"
+#include "BatchRunner.h"
+#include "Sha256.h"
+#include "MsgPrint.h"
+
+using std::ifstream;
+using std::ofstream;
+using std::istringstream;
+using std::set;
+using std::lock_guard;
+using std::mutex;
+using std::make_pair;
+
+// change whenever the segmentation changes its outputs for the same input and configs
+static const int OUTPUT_VERSION = 1;
+
+// configs that do not change the outputs, only how fast they are produced
+static const char *RUNTIME_CONFIGS[] = {"threads", "tile_memory_budget", "queue_lease_timeout", "skip_unchanged_pages", "stage_cache", "profile", "profile_counters", "timeline", "batch_report", "batch_report_interval", "serve_queue_limit", "serve_max_connections"};
+
+ResultCache::ResultCache(const vector<PageJob> &jobs, const map<string, double> &configs, bool dumpall)
+	: jobs(jobs), digests(jobs.size()) {
+	set<string> runtime(RUNTIME_CONFIGS, RUNTIME_CONFIGS + sizeof(RUNTIME_CONFIGS)/sizeof(RUNTIME_CONFIGS[0]));
+	char line[1000];
+	sprintf(line, "version=%d\ndumpall=%d\n", OUTPUT_VERSION, dumpall ? 1 : 0);
+	configText = line;
+	for (map<string, double>::const_iterator it = configs.begin(); it != configs.end(); ++it) {
+		if (runtime.count(it->first))
+			continue;
+		sprintf(line, "%s=%.17g\n", it->first.c_str(), it->second);
+		configText += line;
+	}
+
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		Record rec;
+		if (readRecord(i, rec))
+			pagesByDigest[rec.digest].push_back(i);
+	}
+}
+
+string ResultCache::basename(size_t index) const {
+	return jobs[index].outdir + jobs[index].prefix;
+}
+
+bool ResultCache::readRecord(size_t index, Record &rec) const {
+	ifstream f((basename(index) + "_digest.txt").c_str());
+	if (!f.is_open())
+		return false;
+	rec.files.clear();
+	string line, key;
+	while (getline(f, line)) {
+		istringstream ss(line);
+		ss >> key;
+		if (key == "digest") {
+			ss >> rec.digest;
+		}
+		else if (key == "file") {
+			long size;
+			string suffix;
+			if (!(ss >> size >> suffix))
+				return false;
+			rec.files.push_back(make_pair(size, suffix));
+		}
+	}
+	return rec.digest.length() == 64;
+}
+
+// write to a temporary file first, a record is either complete or missing
+void ResultCache::writeRecord(size_t index, const Record &rec) {
+	string fileName = basename(index) + "_digest.txt";
+	string tmpName = fileName + ".tmp";
+	FILE *f = fopen(tmpName.c_str(), "w");
+	if (f == NULL) {
+		MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot write digest record " + tmpName).c_str());
+		return;
+	}
+	fprintf(f, "digest %s\n", rec.digest.c_str());
+	for (size_t i = 0; i < rec.files.size(); ++i)
+		fprintf(f, "file %ld %s\n", rec.files[i].first, rec.files[i].second.c_str());
+	bool ok = (fclose(f) == 0);
+	if (!ok || rename(tmpName.c_str(), fileName.c_str()) != 0) {
+		remove(tmpName.c_str());
+		MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot write digest record " + fileName).c_str());
+	}
+
+	lock_guard<mutex> lock(mtx);
+	pagesByDigest[rec.digest].push_back(index);
+}
+
+bool ResultCache::outputsValid(size_t index, const Record &rec) const {
+	string base = basename(index);
+	for (size_t i = 0; i < rec.files.size(); ++i) {
+		struct stat st;
+		if (stat((base + rec.files[i].second).c_str(), &st) != 0 || st.st_size != rec.files[i].first)
+			return false;
+	}
+	return true;
+}
+
+// empty if the image cannot be read, reading the page reports the error then
+string ResultCache::inputDigest(size_t index) const {
+	Sha256 sha;
+	if (!sha.updateFile(jobs[index].image.c_str()))
+		return "";
+	sha.update(configText);
+	return sha.hexDigest();
+}
+
+ResultCache::STATUS ResultCache::lookup(size_t index) {
+	digests[index] = inputDigest(index);
+	const string &digest = digests[index];
+	if (digest.empty())
+		return MISSING;
+
+	Record rec;
+	bool hasRecord = readRecord(index, rec);
+	if (hasRecord && rec.digest == digest && outputsValid(index, rec))
+		return UPTODATE;
+	// the outputs are about to be replaced
+	if (hasRecord)
+		remove((basename(index) + "_digest.txt").c_str());
+
+	vector<size_t> candidates;
+	{
+		lock_guard<mutex> lock(mtx);
+		map< string, vector<size_t> >::const_iterator it = pagesByDigest.find(digest);
+		if (it != pagesByDigest.end())
+			candidates = it->second;
+	}
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		size_t from = candidates[i];
+		Record src;
+		if (from == index || basename(from) == basename(index))
+			continue;
+		if (!readRecord(from, src) || src.digest != digest || !outputsValid(from, src))
+			continue;
+
+		if (!BatchRunner::makeDirs(jobs[index].outdir))
+			MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot create output directory " + jobs[index].outdir).c_str());
+		string fromBase = basename(from), toBase = basename(index);
+		for (size_t j = 0; j < src.files.size(); ++j) {
+			string toName = toBase + src.files[j].second;
+			ifstream in((fromBase + src.files[j].second).c_str(), std::ios::binary);
+			ofstream out(toName.c_str(), std::ios::binary);
+			if (!(out << in.rdbuf()) || !out.flush())
+				MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot write " + toName).c_str());
+		}
+		writeRecord(index, src);
+		return REUSED;
+	}
+	return MISSING;
+}
+
+void ResultCache::store(size_t index, const vector<string> &files) {
+	if (digests[index].empty())
+		return;
+	string base = basename(index);
+	Record rec;
+	rec.digest = digests[index];
+	for (size_t i = 0; i < files.size(); ++i) {
+		struct stat st;
+		if (files[i].compare(0, base.length(), base) != 0 || stat(files[i].c_str(), &st) != 0)
+			MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot find written file " + files[i]).c_str());
+		rec.files.push_back(make_pair((long)st.st_size, files[i].substr(base.length())));
+	}
+	writeRecord(index, rec);
+}
@@ -0,0 +1,54 @@
+#ifndef __RESULTCACHE_H__
+#define __RESULTCACHE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "PageProcessor.h"
+using std::map;
+using std::string;
+using std::vector;
+
+// skips pages of a batch whose outputs are up to date, and reuses the outputs of byte-identical pages
+// every written page gets a record <outdir><prefix>_digest.txt next to its outputs:
+//   digest <hex>           SHA-256 of the input image bytes, the segmentation configs and the output version
+//   file <size> <suffix>   one line per written file, named <outdir><prefix><suffix>
+// a page is up to date if its record has the same digest and all recorded files exist with the recorded sizes.
+// otherwise a page with the same digest and valid outputs, under another name, is copied.
+// only pages finished before a page is looked up are reused, in-flight duplicates are segmented again.
+class ResultCache {
+public:
+	enum STATUS {MISSING, UPTODATE, REUSED};
+
+	// jobs: the pages of the batch, records of these pages found on disk are candidates for reuse
+	ResultCache(const vector<PageJob> &jobs, const map<string, double> &configs, bool dumpall);
+
+	// MISSING: the page needs to be processed, an outdated record is removed
+	// UPTODATE: the outputs of the page are up to date
+	// REUSED: the outputs were copied from a page with identical input
+	STATUS lookup(size_t index);
+	// record the files written for a processed page
+	void store(size_t index, const vector<string> &files);
+
+private:
+	struct Record {
+		string digest;
+		vector< std::pair<long, string> > files;  // (size, suffix)
+	};
+
+	string basename(size_t index) const;
+	bool readRecord(size_t index, Record &rec) const;
+	void writeRecord(size_t index, const Record &rec);
+	bool outputsValid(size_t index, const Record &rec) const;
+	string inputDigest(size_t index) const;
+
+	const vector<PageJob> &jobs;
+	string configText;  // configs that affect the outputs, and dumpall
+	vector<string> digests;  // input digest of each looked up page
+
+	std::mutex mtx;
+	map< string, vector<size_t> > pagesByDigest;  // pages with a record, records are checked again before reuse
+};
+
+#endif
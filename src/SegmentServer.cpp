@@ -0,0 +1,395 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <thread>
+#include <algorithm>
+#include <sstream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "SegmentServer.h"
+#include "MsgPrint.h"
+
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+using std::istringstream;
+
+static const size_t MAX_LINE = 1 << 16;
+static const int64_t MAX_PAGE_PIXELS = (int64_t)1 << 28;
+// seconds a send or receive may stall while a page holds a worker
+static const int PAGE_IO_TIMEOUT = 60;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int) {
+	stopRequested = 1;
+}
+
+// buffered reads and writes on a connection socket, the page buffers belong to the workers
+struct SegmentServer::Connection {
+	int fd;
+	vector<char> in;
+	size_t inPos, inLen;
+	string out;
+
+	Connection(int fd) : fd(fd), in(MAX_LINE), inPos(0), inLen(0) {}
+
+	bool fill() {
+		inPos = 0;
+		while (true) {
+			ssize_t n = recv(fd, in.data(), in.size(), 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			inLen = (n > 0) ? n : 0;
+			return n > 0;
+		}
+	}
+	// a line without its '\n', false at the end of the stream or for an overlong line
+	bool readLine(string &line) {
+		line.clear();
+		while (true) {
+			if (inPos == inLen && !fill())
+				return false;
+			char *st = in.data() + inPos, *nl = (char *)memchr(st, '\n', inLen - inPos);
+			if (nl != NULL) {
+				line.append(st, nl - st);
+				inPos += nl - st + 1;
+				return true;
+			}
+			line.append(st, inLen - inPos);
+			inPos = inLen;
+			if (line.size() > MAX_LINE)
+				return false;
+		}
+	}
+	bool readBytes(uint8_t *dst, size_t n) {
+		size_t k = std::min(n, inLen - inPos);
+		memcpy(dst, in.data() + inPos, k);
+		inPos += k;
+		while (k < n) {
+			ssize_t r = recv(fd, dst + k, n - k, 0);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				return false;
+			k += r;
+		}
+		return true;
+	}
+	// read and drop the bytes of a page that is not segmented
+	bool skipBytes(size_t n) {
+		while (n > 0) {
+			if (inPos == inLen && !fill())
+				return false;
+			size_t k = std::min(n, inLen - inPos);
+			inPos += k;
+			n -= k;
+		}
+		return true;
+	}
+	// 0: no timeout
+	void setTimeout(int seconds) {
+		timeval tv = {seconds, 0};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	}
+	bool writeBytes(const void *data, size_t n) {
+		const char *p = (const char *)data;
+		while (n > 0) {
+			ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				return false;
+			p += r;
+			n -= r;
+		}
+		return true;
+	}
+	void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+		char buf[1024];
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		out.append(buf, std::min(n, (int)sizeof(buf)-1));
+	}
+	bool flush() {
+		bool ok = writeBytes(out.data(), out.size());
+		out.clear();
+		return ok;
+	}
+};
+
+// a Segmenter with the buffers of its pages, kept from page to page
+struct SegmentServer::Worker {
+	Segmenter seg;
+	vector<uint8_t> pixels;
+	Segmenter::Result result;
+};
+
+SegmentServer::SegmentServer(const map<string, double> &configs, int workers, ThreadPool *pool) {
+	this->configs = configs;
+	if (workers <= 0)
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < workers; ++i) {
+		Worker *worker = new Worker();
+		for (map<string, double>::const_iterator it = configs.begin(); it != configs.end(); ++it)
+			worker->seg.setConfig(it->first, it->second);
+		worker->seg.setThreadPool(pool);
+		this->workers.push_back(worker);
+	}
+	idle = this->workers;
+	queueLimit = (configs.at("serve_queue_limit") > 0) ? configs.at("serve_queue_limit") : 0;
+	maxConnections = (configs.at("serve_max_connections") > 1) ? configs.at("serve_max_connections") : 1;
+	waiting = 0;
+	requests = failed = busy = 0;
+}
+
+SegmentServer::~SegmentServer() {
+	for (size_t i = 0; i < workers.size(); ++i)
+		delete workers[i];
+}
+
+SegmentServer::Worker *SegmentServer::acquire() {
+	unique_lock<mutex> lock(mtx);
+	if (idle.empty() && waiting >= queueLimit)
+		return NULL;
+	++waiting;
+	workerFreed.wait(lock, [this] { return !idle.empty(); });
+	--waiting;
+	Worker *worker = idle.back();
+	idle.pop_back();
+	return worker;
+}
+
+void SegmentServer::release(Worker *worker) {
+	{
+		lock_guard<mutex> lock(mtx);
+		idle.push_back(worker);
+	}
+	workerFreed.notify_one();
+}
+
+// return false if the connection cannot go on, i.e. the page bytes could not be read or the answer not sent
+// a worker is taken before the page bytes are read, into its buffers, so buffered pages never exceed the workers
+bool SegmentServer::servePage(Connection &conn, const vector<string> &args) {
+	int64_t width = (args.size() >= 5) ? atoll(args[1].c_str()) : 0;
+	int64_t height = (args.size() >= 5) ? atoll(args[2].c_str()) : 0;
+	if (width <= 0 || height <= 0 || width * height > MAX_PAGE_PIXELS) {
+		conn.printf("ERR %d Expected PAGE <width> <height> <binary|gray> <masks>, at most %lld pixels\n",
+				Segmenter::INVALID_ARGUMENT, (long long)MAX_PAGE_PIXELS);
+		return false;
+	}
+	size_t bytes = width * height;
+	if (args[3] != "binary" && args[3] != "gray") {
+		conn.printf("ERR %d Unknown pixel format %s\n", Segmenter::INVALID_ARGUMENT, args[3].c_str());
+		return conn.skipBytes(bytes);
+	}
+	Segmenter::FORMAT format = (args[3] == "gray") ? Segmenter::GRAY : Segmenter::BINARY;
+	uint32_t masks = atoi(args[4].c_str());
+	map<string, double> overrides;
+	for (size_t i = 5; i < args.size(); ++i) {
+		size_t eq = args[i].find('=');
+		if (eq == string::npos || eq == 0 || configs.count(args[i].substr(0, eq)) == 0) {
+			conn.printf("ERR %d Unknown config %s\n", Segmenter::UNKNOWN_CONFIG, args[i].c_str());
+			return conn.skipBytes(bytes);
+		}
+		overrides[args[i].substr(0, eq)] = atof(args[i].c_str() + eq + 1);
+	}
+
+	Worker *worker = acquire();
+	if (worker == NULL) {
+		{
+			lock_guard<mutex> lock(mtx);
+			++busy;
+			conn.printf("BUSY %zu requests are waiting for a worker\n", waiting);
+		}
+		return conn.skipBytes(bytes);
+	}
+	// a client stalling in the middle of a page loses its connection instead of holding the worker
+	conn.setTimeout(PAGE_IO_TIMEOUT);
+	bool ok = false;
+	try {
+		worker->pixels.resize(bytes);
+		ok = conn.readBytes(worker->pixels.data(), bytes);
+	}
+	catch (const std::bad_alloc &) {
+		conn.printf("ERR %d Out of memory\n", Segmenter::OUT_OF_MEMORY);
+		ok = conn.skipBytes(bytes);
+		release(worker);
+		conn.setTimeout(0);
+		return ok;
+	}
+	if (ok)
+		ok = segmentPage(conn, worker, width, height, format, masks, overrides);
+	release(worker);
+	conn.setTimeout(0);
+	return ok;
+}
+
+// segment the page in the worker's buffer and send the answer from the worker's result
+bool SegmentServer::segmentPage(Connection &conn, Worker *worker, int width, int height, Segmenter::FORMAT format,
+		uint32_t masks, const map<string, double> &overrides) {
+	Segmenter &seg = worker->seg;
+	for (map<string, double>::const_iterator it = overrides.begin(); it != overrides.end(); ++it)
+		seg.setConfig(it->first, it->second);
+	Segmenter::Result &res = worker->result;
+	Segmenter::STATUS status = seg.segment(worker->pixels.data(), width, height, width, format, masks, res);
+	for (map<string, double>::const_iterator it = overrides.begin(); it != overrides.end(); ++it)
+		seg.setConfig(it->first, configs[it->first]);
+	{
+		lock_guard<mutex> lock(mtx);
+		++requests;
+		if (status != Segmenter::OK)
+			++failed;
+	}
+
+	if (status != Segmenter::OK) {
+		conn.printf("ERR %d %s\n", status, seg.getError().c_str());
+		return true;
+	}
+	conn.printf("OK %d %d %d %zu %zu\n", res.width, res.height, res.charH, res.lines.size(), res.words.size());
+	for (size_t i = 0; i < res.lines.size(); ++i) {
+		const Segmenter::Line &l = res.lines[i];
+		conn.printf("LINE %d %d %d %d %d %d %d\n", l.lineID, l.xl, l.xh, l.yl, l.yh, l.firstWord, l.wordCnt);
+	}
+	for (size_t i = 0; i < res.words.size(); ++i) {
+		const Segmenter::Word &w = res.words[i];
+		conn.printf("WORD %d %d %d %d %d %d\n", w.wordID, w.lineID, w.xl, w.xh, w.yl, w.yh);
+	}
+	// masks are sent straight from the result, not through the text buffer
+	const vector<int32_t> *planes[2] = {&res.lineMask, &res.wordMask};
+	const char *names[2] = {"line", "word"};
+	for (int k = 0; k < 2; ++k) {
+		if (planes[k]->empty())
+			continue;
+		conn.printf("MASK %s %zu\n", names[k], planes[k]->size() * sizeof(int32_t));
+		if (!conn.flush() || !conn.writeBytes(planes[k]->data(), planes[k]->size() * sizeof(int32_t)))
+			return false;
+	}
+	conn.printf("END\n");
+	return conn.flush();
+}
+
+void SegmentServer::serve(int fd) {
+	char ctx[64];
+	snprintf(ctx, sizeof(ctx), "connection %d", fd);
+	MsgPrint::setContext(ctx);
+	Connection conn(fd);
+	string line;
+	while (conn.readLine(line)) {
+		istringstream ss(line);
+		vector<string> args;
+		string a;
+		while (ss >> a)
+			args.push_back(a);
+		if (args.empty())
+			continue;
+		bool ok = true;
+		if (args[0] == "PAGE")
+			ok = servePage(conn, args);
+		else if (args[0] == "STATS") {
+			lock_guard<mutex> lock(mtx);
+			conn.printf("STATS %ld %ld %ld %zu %zu %zu\n", requests, failed, busy, workers.size() - idle.size(), waiting,
+					openConnections.size());
+		}
+		else if (args[0] == "QUIT")
+			break;
+		else
+			conn.printf("ERR %d Unknown request %s\n", Segmenter::INVALID_ARGUMENT, args[0].c_str());
+		if (!conn.flush() || !ok)
+			break;
+	}
+	MsgPrint::setContext(NULL);
+	// closed under the lock, so that run() never shuts down a reused descriptor;
+	// notified under the lock, once run() sees no connections the server may be destroyed
+	lock_guard<mutex> lock(mtx);
+	openConnections.erase(fd);
+	close(fd);
+	connectionClosed.notify_all();
+}
+
+int SegmentServer::run(const string &address) {
+	bool tcp = !address.empty() && address.find_first_not_of("0123456789") == string::npos;
+	int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+	int bound = -1;
+	if (fd >= 0 && tcp) {
+		int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(atoi(address.c_str()));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bound = bind(fd, (sockaddr *)&addr, sizeof(addr));
+	}
+	else if (fd >= 0 && address.size() < sizeof(sockaddr_un().sun_path)) {
+		// a socket file left by a daemon that did not stop cleanly
+		unlink(address.c_str());
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, address.c_str());
+		bound = bind(fd, (sockaddr *)&addr, sizeof(addr));
+	}
+	if (bound != 0 || listen(fd, 64) != 0) {
+		MsgPrint::msgPrint(MsgPrint::WARN, ("Cannot listen on " + address + ": " + strerror(errno)).c_str());
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onStopSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	char msg[1000];
+	snprintf(msg, sizeof(msg), "Serving on %s%s with %zu workers ......", tcp ? "127.0.0.1:" : "", address.c_str(), workers.size());
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+
+	// the signal may be delivered to any thread, so the flag is polled
+	while (!stopRequested) {
+		pollfd p = {fd, POLLIN, 0};
+		if (poll(&p, 1, 200) <= 0)
+			continue;
+		int c = accept(fd, NULL, NULL);
+		if (c < 0)
+			continue;
+		lock_guard<mutex> lock(mtx);
+		if (openConnections.size() >= maxConnections) {
+			++busy;
+			static const char reply[] = "BUSY too many connections\n";
+			send(c, reply, sizeof(reply)-1, MSG_NOSIGNAL | MSG_DONTWAIT);
+			close(c);
+			continue;
+		}
+		try {
+			std::thread(&SegmentServer::serve, this, c).detach();
+			openConnections.insert(c);
+		}
+		catch (const std::exception &) {
+			close(c);
+		}
+	}
+	close(fd);
+	if (!tcp)
+		unlink(address.c_str());
+
+	// pages in progress are finished and answered, idle connections see the end of their stream
+	MsgPrint::msgPrint(MsgPrint::INFO, "Stopping, finishing the requests in progress ......");
+	unique_lock<mutex> lock(mtx);
+	for (set<int>::iterator it = openConnections.begin(); it != openConnections.end(); ++it)
+		shutdown(*it, SHUT_RD);
+	connectionClosed.wait(lock, [this] { return openConnections.empty(); });
+	return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef __SEGMENTSERVER_H__
+#define __SEGMENTSERVER_H__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "Segmenter.h"
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+class ThreadPool;
+
+// a long-running segmentation daemon on a Unix domain socket or a local TCP port
+// workers Segmenters stay warm between pages, sharing one thread pool; their planes and page buffers are reused page after page.
+// every connection is served by its own thread, at most serve_max_connections, further ones are answered BUSY and closed.
+// a request holds a worker while its page is read, segmented and answered; at most serve_queue_limit requests
+// wait for a worker, further ones are answered BUSY at once, their page bytes are read and discarded to keep the stream in sync.
+//
+// protocol, text lines ending in '\n', a connection sends any number of requests one after the other
+//   PAGE <width> <height> <binary|gray> <masks> [<config>=<value> ...]
+//       followed by width*height bytes, one per pixel, rows from the top; masks: 1 line mask, 2 word mask, 3 both
+//       the configs override the daemon's configs for this page only
+//     -> OK <width> <height> <charH> <lines> <words>
+//        LINE <lineID> <xl> <xh> <yl> <yh> <firstWord> <wordCnt>     one per line
+//        WORD <wordID> <lineID> <xl> <xh> <yl> <yh>                   one per word
+//        MASK <line|word> <bytes>                                     followed by width*height int32 labels, host byte order
+//        END
+//     -> ERR <status> <message>   status as Segmenter::STATUS, or BUSY <message>
+//   STATS -> STATS <requests> <failed> <busy> <active> <waiting> <connections>
+//   QUIT  closes the connection
+class SegmentServer {
+public:
+	// workers: pages segmented at the same time, 0: one per hardware thread
+	SegmentServer(const map<string, double> &configs, int workers, ThreadPool *pool);
+	~SegmentServer();
+	// address: a port number for 127.0.0.1, otherwise the path of a Unix domain socket
+	// serve until SIGINT or SIGTERM, then finish the requests in progress, return non-zero if the address cannot be bound
+	int run(const string &address);
+
+private:
+	struct Connection;
+	struct Worker;
+	// the connection's request loop, runs in its own thread
+	void serve(int fd);
+	bool servePage(Connection &conn, const vector<string> &args);
+	bool segmentPage(Connection &conn, Worker *worker, int width, int height, Segmenter::FORMAT format,
+			uint32_t masks, const map<string, double> &overrides);
+	// a free worker, NULL if too many requests are waiting
+	Worker *acquire();
+	void release(Worker *worker);
+
+	map<string, double> configs;
+	vector<Worker *> workers;
+	vector<Worker *> idle;
+	size_t queueLimit;
+	size_t maxConnections;
+	std::mutex mtx;
+	std::condition_variable workerFreed, connectionClosed;
+	size_t waiting;
+	set<int> openConnections;  // sockets, shut down to end the connections when the daemon stops
+	long requests, failed, busy;
+};
+
+#endif
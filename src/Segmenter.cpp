@@ -0,0 +1,117 @@
+#include <new>
+#include <exception>
+#include <algorithm>
+#include "Segmenter.h"
+#include "HandwrittenImage.h"
+#include "ConfigParser.h"
+#include "ThreadPool.h"
+#include "PageProcessor.h"
+#include "MsgPrint.h"
+
+Segmenter::Segmenter() {
+	configs = ConfigParser().getConfigs();
+	grayThreshold = 128;
+	img = new HandwrittenImage();
+	threadPool = NULL;
+	threadPoolSize = -1;
+	sharedThreadPool = NULL;
+	// a failing page returns an error instead of ending the caller's process
+	MsgPrint::setErrAction(MsgPrint::THROW);
+}
+
+Segmenter::~Segmenter() {
+	delete img;
+	delete threadPool;
+}
+
+Segmenter::STATUS Segmenter::fail(STATUS status, const string &msg) {
+	error = msg;
+	return status;
+}
+
+// the vectors keep their memory for the next page
+void Segmenter::clearResult(Result &result) {
+	result.width = result.height = result.charH = 0;
+	result.lines.clear();
+	result.words.clear();
+	result.lineMask.clear();
+	result.wordMask.clear();
+}
+
+Segmenter::STATUS Segmenter::setConfig(const string &name, double value) {
+	if (configs.count(name) == 0)
+		return fail(UNKNOWN_CONFIG, "Unknown config " + name);
+	configs[name] = value;
+	return OK;
+}
+
+void Segmenter::setLogLevel(int level) {
+	MsgPrint::setLevel((level <= 0) ? MsgPrint::ERR : (level == 1) ? MsgPrint::WARN : MsgPrint::INFO);
+}
+
+Segmenter::STATUS Segmenter::segment(const uint8_t *pixels, int width, int height, int stride, FORMAT format, uint32_t masks, Result &result) {
+	clearResult(result);
+	if (pixels == NULL || width <= 0 || height <= 0 || stride < width || (format != BINARY && format != GRAY))
+		return fail(INVALID_ARGUMENT, "Invalid image buffer");
+	try {
+		if (sharedThreadPool == NULL && (threadPool == NULL || threadPoolSize != (int)configs["threads"])) {
+			delete threadPool;
+			threadPool = NULL;
+			threadPool = new ThreadPool(configs["threads"]);
+			threadPoolSize = configs["threads"];
+		}
+		img->setThreadPool((sharedThreadPool != NULL) ? sharedThreadPool : threadPool);
+		// in tiled mode the planes of the masks must be kept to the end
+		img->setOutputTypes(((masks & LINE_MASK) ? HandwrittenImage::outputBit(HandwrittenImage::NOSLANT) : 0) |
+				((masks & WORD_MASK) ? HandwrittenImage::outputBit(HandwrittenImage::WORDMAP) : 0));
+		img->readPixels(pixels, width, height, stride, format == GRAY, grayThreshold);
+
+		// without files there is nothing to resume from
+		map<string, double> pageConfigs = configs;
+		pageConfigs["stage_cache"] = 0;
+		segmentPage(*img, PageJob(), pageConfigs);
+
+		result.width = width;
+		result.height = height;
+		result.charH = img->getCharH();
+		const vector<HandwrittenImage::WordBBox> &boxes = img->getWordBoxes();
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			const HandwrittenImage::WordBBox &b = boxes[i];
+			Word w = {b.wordID, b.regionID, b.xl, b.xh, b.yl, b.yh};
+			result.words.push_back(w);
+			// words of a line are consecutive
+			if (result.lines.empty() || result.lines.back().lineID != b.regionID) {
+				Line l = {b.regionID, b.xl, b.xh, b.yl, b.yh, (int)i, 0};
+				result.lines.push_back(l);
+			}
+			Line &l = result.lines.back();
+			l.xl = std::min(l.xl, b.xl);
+			l.xh = std::max(l.xh, b.xh);
+			l.yl = std::min(l.yl, b.yl);
+			l.yh = std::max(l.yh, b.yh);
+			l.wordCnt += 1;
+		}
+		if (masks & LINE_MASK) {
+			result.lineMask.resize((size_t)width * height);
+			img->getLabels(HandwrittenImage::NOSLANT, result.lineMask.data());
+		}
+		if (masks & WORD_MASK) {
+			result.wordMask.resize((size_t)width * height);
+			img->getLabels(HandwrittenImage::WORDMAP, result.wordMask.data());
+		}
+	}
+	catch (const MsgPrint::Error &e) {
+		clearResult(result);
+		return fail(SEGMENTATION_FAILED, e.what());
+	}
+	catch (const std::bad_alloc &) {
+		clearResult(result);
+		return fail(OUT_OF_MEMORY, "Out of memory");
+	}
+	// e.g. a thread of the pool that cannot be started
+	catch (const std::exception &e) {
+		clearResult(result);
+		return fail(SEGMENTATION_FAILED, string("Cannot segment the page: ") + e.what());
+	}
+	return OK;
+}
@@ -0,0 +1,79 @@
+#ifndef __SEGMENTER_H__
+#define __SEGMENTER_H__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+using std::map;
+using std::string;
+using std::vector;
+
+class HandwrittenImage;
+class ThreadPool;
+
+// the segmentation pipeline as a library: pages are read from memory, results are returned in memory,
+// errors are returned as a STATUS instead of exiting the process. No files are read or written.
+// a Segmenter keeps its thread pool and planes from page to page, it segments one page at a time,
+// concurrent pages need one Segmenter each. SegmenterC.h is the C interface.
+class Segmenter {
+public:
+	enum STATUS {OK, INVALID_ARGUMENT, UNKNOWN_CONFIG, SEGMENTATION_FAILED, OUT_OF_MEMORY};
+	// one byte per pixel, BINARY: nonzero is black, GRAY: below the gray threshold is black
+	enum FORMAT {BINARY, GRAY};
+	// label planes to return, or-ed together
+	enum MASK {LINE_MASK = 1, WORD_MASK = 2};
+
+	struct Line {
+		int lineID;
+		int xl, xh, yl, yh;  // union of the boxes of its words
+		int firstWord, wordCnt;  // words[firstWord .. firstWord+wordCnt)
+	};
+	struct Word {
+		int wordID;  // words[i].wordID is i+1
+		int lineID;
+		int xl, xh, yl, yh;
+	};
+	struct Result {
+		int width, height, charH;
+		vector<Line> lines;  // lines holding words, in order of line ID
+		vector<Word> words;  // line by line, left to right
+		// width*height, row by row, empty unless requested: the line or word ID of the pixels of lines or words, 0 elsewhere
+		// boxes and masks are in the coordinates of the slant corrected page, as the word images of the engine
+		vector<int32_t> lineMask, wordMask;
+	};
+
+	// the built-in default configs of ConfigParser
+	Segmenter();
+	~Segmenter();
+	// name: a key of default.config, the file-based ones (stage_cache, profile, timeline, batch_*) are ignored
+	STATUS setConfig(const string &name, double value);
+	const map<string, double> &getConfigs() const { return configs; }
+	// gray level below which a GRAY pixel is black, 128 by default
+	void setGrayThreshold(int threshold) { grayThreshold = threshold; }
+	// share a thread pool with other Segmenters instead of owning one of threads threads, NULL: own one again
+	void setThreadPool(ThreadPool *pool) { sharedThreadPool = pool; }
+
+	// segment a page of width x height pixels, rows from the top, stride bytes apart
+	// masks: the label planes to return, an or of MASK
+	STATUS segment(const uint8_t *pixels, int width, int height, int stride, FORMAT format, uint32_t masks, Result &result);
+	// the message of the last call that did not return OK
+	const string &getError() const { return error; }
+
+	// least severe messages printed to stderr, 0: errors, 1: warnings, 2: progress (default), for all Segmenters
+	static void setLogLevel(int level);
+
+private:
+	STATUS fail(STATUS status, const string &msg);
+	static void clearResult(Result &result);
+
+	map<string, double> configs;
+	int grayThreshold;
+	HandwrittenImage *img;
+	ThreadPool *threadPool;
+	int threadPoolSize;  // threads config the pool was made for
+	ThreadPool *sharedThreadPool;  // set by setThreadPool, not owned
+	string error;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include <new>
+#include "SegmenterC.h"
+#include "Segmenter.h"
+
+struct segmenter {
+	Segmenter seg;
+	Segmenter::Result result;
+	vector<segmenter_line> lines;
+	vector<segmenter_word> words;
+};
+
+segmenter *segmenter_create(void) {
+	return new (std::nothrow) segmenter;
+}
+
+void segmenter_destroy(segmenter *seg) {
+	delete seg;
+}
+
+int segmenter_set_config(segmenter *seg, const char *name, double value) {
+	if (seg == NULL || name == NULL)
+		return SEGMENTER_INVALID_ARGUMENT;
+	return seg->seg.setConfig(name, value);
+}
+
+void segmenter_set_gray_threshold(segmenter *seg, int threshold) {
+	if (seg != NULL)
+		seg->seg.setGrayThreshold(threshold);
+}
+
+int segmenter_segment(segmenter *seg, const uint8_t *pixels, int width, int height, int stride, int format, unsigned masks, segmenter_result *result) {
+	if (seg == NULL || result == NULL)
+		return SEGMENTER_INVALID_ARGUMENT;
+	int status = seg->seg.segment(pixels, width, height, stride, (Segmenter::FORMAT)format, masks, seg->result);
+	const Segmenter::Result &r = seg->result;
+	try {
+		seg->lines.resize(r.lines.size());
+		for (size_t i = 0; i < r.lines.size(); ++i) {
+			const Segmenter::Line &l = r.lines[i];
+			segmenter_line c = {l.lineID, l.xl, l.xh, l.yl, l.yh, l.firstWord, l.wordCnt};
+			seg->lines[i] = c;
+		}
+		seg->words.resize(r.words.size());
+		for (size_t i = 0; i < r.words.size(); ++i) {
+			const Segmenter::Word &w = r.words[i];
+			segmenter_word c = {w.wordID, w.lineID, w.xl, w.xh, w.yl, w.yh};
+			seg->words[i] = c;
+		}
+	}
+	catch (const std::bad_alloc &) {
+		seg->lines.clear();
+		seg->words.clear();
+		status = SEGMENTER_OUT_OF_MEMORY;
+	}
+	result->width = r.width;
+	result->height = r.height;
+	result->char_height = r.charH;
+	result->line_count = seg->lines.size();
+	result->word_count = seg->words.size();
+	result->lines = seg->lines.empty() ? NULL : seg->lines.data();
+	result->words = seg->words.empty() ? NULL : seg->words.data();
+	result->line_mask = r.lineMask.empty() ? NULL : r.lineMask.data();
+	result->word_mask = r.wordMask.empty() ? NULL : r.wordMask.data();
+	return status;
+}
+
+const char *segmenter_error(const segmenter *seg) {
+	return (seg == NULL) ? "No segmenter" : seg->seg.getError().c_str();
+}
+
+void segmenter_set_log_level(int level) {
+	Segmenter::setLogLevel(level);
+}
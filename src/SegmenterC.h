@@ -0,0 +1,57 @@
+#ifndef __SEGMENTERC_H__
+#define __SEGMENTERC_H__
+
+#include <stdint.h>
+
+// C interface of Segmenter.h, for callers that cannot use C++
+// every function returning int returns a SEGMENTER_STATUS, segmenter_error gives the message of the last failure
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum SEGMENTER_STATUS {SEGMENTER_OK, SEGMENTER_INVALID_ARGUMENT, SEGMENTER_UNKNOWN_CONFIG, SEGMENTER_SEGMENTATION_FAILED, SEGMENTER_OUT_OF_MEMORY};
+// one byte per pixel, BINARY: nonzero is black, GRAY: below the gray threshold is black
+enum SEGMENTER_FORMAT {SEGMENTER_BINARY, SEGMENTER_GRAY};
+enum SEGMENTER_MASK {SEGMENTER_LINE_MASK = 1, SEGMENTER_WORD_MASK = 2};
+
+typedef struct segmenter segmenter;
+
+typedef struct {
+	int line_id;
+	int xl, xh, yl, yh;
+	int first_word, word_count;
+} segmenter_line;
+
+typedef struct {
+	int word_id;
+	int line_id;
+	int xl, xh, yl, yh;
+} segmenter_word;
+
+// memory of the segmenter, valid until its next segmenter_segment or segmenter_destroy
+typedef struct {
+	int width, height, char_height;
+	int line_count, word_count;
+	const segmenter_line *lines;
+	const segmenter_word *words;
+	// width*height, row by row, NULL unless requested
+	const int32_t *line_mask, *word_mask;
+} segmenter_result;
+
+// NULL if out of memory
+segmenter *segmenter_create(void);
+void segmenter_destroy(segmenter *seg);
+int segmenter_set_config(segmenter *seg, const char *name, double value);
+void segmenter_set_gray_threshold(segmenter *seg, int threshold);
+// format: a SEGMENTER_FORMAT, masks: an or of SEGMENTER_MASK
+int segmenter_segment(segmenter *seg, const uint8_t *pixels, int width, int height, int stride, int format, unsigned masks, segmenter_result *result);
+const char *segmenter_error(const segmenter *seg);
+// 0: errors, 1: warnings, 2: progress
+void segmenter_set_log_level(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
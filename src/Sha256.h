@@ -0,0 +1,29 @@
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+using std::string;
+
+// SHA-256 message digest (FIPS 180-4)
+class Sha256 {
+public:
+	Sha256();
+	void update(const void *data, size_t len);
+	void update(const string &s) { update(s.data(), s.length()); }
+	// add the bytes of a file, return false if it cannot be read
+	bool updateFile(const char *fileName);
+	// digest as 64 lowercase hex characters, no more data can be added afterwards
+	string hexDigest();
+
+private:
+	void compress(const uint8_t *block);
+
+	uint32_t state[8];
+	uint8_t buffer[64];
+	size_t bufferLen;
+	uint64_t totalLen;  // bytes
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __SPANFILL_H__
+#define __SPANFILL_H__
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+using std::vector;
+
+// scanline flood fill over a width x height grid, spans run along y, the contiguous axis of PIXELS
+// fills the 4- (or 8-) connected set of pixels where inside(x, y) holds, starting at (xCoord, yCoord) which must be inside
+// fillSpan(x, y1, y2) is called once on every maximal run [y1, y2] of column x and must make inside false on it.
+// a run is filled when it is found and pushed once, so the stack never holds more entries than the set has runs,
+// at most one per pixel and about one per column for solid areas; a per-pixel BFS queue can hold several times the pixel count
+// returns the number of runs filled
+template <class Inside, class FillSpan>
+uint64_t spanFill(int width, int height, int xCoord, int yCoord, bool neighbor8, Inside inside, FillSpan fillSpan) {
+	struct Span {
+		int x, y1, y2;
+	};
+	vector<Span> stack;
+	uint64_t runs = 0;
+	// the run through (x, y) in column x, y inside
+	auto push = [&](int x, int y) {
+		int y1 = y, y2 = y;
+		while (y1 > 0 && inside(x, y1-1))
+			--y1;
+		while (y2 < height-1 && inside(x, y2+1))
+			++y2;
+		fillSpan(x, y1, y2);
+		stack.push_back(Span{x, y1, y2});
+		++runs;
+		return y2;
+	};
+	push(xCoord, yCoord);
+	while (!stack.empty()) {
+		Span s = stack.back();
+		stack.pop_back();
+		int lo = neighbor8 ? std::max(s.y1-1, 0) : s.y1;
+		int hi = neighbor8 ? std::min(s.y2+1, height-1) : s.y2;
+		for (int x = s.x-1; x <= s.x+1; x += 2) {
+			if (x < 0 || x >= width)
+				continue;
+			for (int y = lo; y <= hi; ++y) {
+				// the pixel after a run is outside
+				if (inside(x, y))
+					y = push(x, y) + 1;
+			}
+		}
+	}
+	return runs;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstring>
+#include "StageCache.h"
+#include "BatchRunner.h"
+#include "ByteStream.h"
+#include "Sha256.h"
+#include "MsgPrint.h"
+
+// change whenever the state saved by a checkpoint changes
+static const int CHECKPOINT_VERSION = 3;
+
+// name of each checkpoint and the configs its stages read, a stage reading charH depends on it through the previous key
+static const struct {
+	const char *name;
+	const char *configs[4];
+} CHECKPOINTS[HandwrittenImage::CKPT_COUNT] = {
+	{"border", {"border_removal_horizontal_segment_weight", "border_removal_vertial_segment_weight", "border_removal_segment_sum_threshold", NULL}},
+	{"charH", {"charH_convergence_diff", "charH_cutoff_ratio", NULL}},
+	{"derivatives", {"blur_width", "blur_height", "first_order_partial_derivative_of_y_window_height", "second_order_partial_derivative_of_y_window_height"}},
+	{"regions", {"space_tracing_seeds_distance", "region_area_min", "region_black_pixel_percentage_min", "region_black_pixel_percentage_max"}},
+	{"textLines", {"text_tracing_seeds_distance", NULL}},
+	{"hulls", {NULL}},
+};
+
+StageCache::StageCache(const string &dir, const char *image, const map<string, double> &configs, bool tiled, uint32_t outputTypes) {
+	this->dir = (dir[dir.length()-1] == '/') ? dir : dir + "/";
+	char line[1000];
+	Sha256 input;
+	if (!input.updateFile(image))
+		return;
+	sprintf(line, "version=%d\ntiled=%d\noutputs=%u\n", CHECKPOINT_VERSION, tiled ? 1 : 0, outputTypes);
+	input.update(line);
+	string key = input.hexDigest();
+
+	for (int i = 0; i < HandwrittenImage::CKPT_COUNT; ++i) {
+		Sha256 sha;
+		sha.update(key);
+		sha.update(CHECKPOINTS[i].name);
+		for (int k = 0; k < 4 && CHECKPOINTS[i].configs[k] != NULL; ++k) {
+			sprintf(line, "\n%s=%.17g", CHECKPOINTS[i].configs[k], configs.at(CHECKPOINTS[i].configs[k]));
+			sha.update(line);
+		}
+		key = sha.hexDigest();
+		keys.push_back(key);
+	}
+}
+
+string StageCache::fileName(int ckpt) const {
+	char name[100];
+	sprintf(name, "%d-%s.ckpt", ckpt+1, CHECKPOINTS[ckpt].name);
+	return dir + name;
+}
+
+int StageCache::restore(HandwrittenImage &img) {
+	int restored = 0;
+	for (int i = 0; i < (int)keys.size(); ++i) {
+		FILE *f = fopen(fileName(i).c_str(), "rb");
+		if (f == NULL)
+			break;
+		// header line "<key>\n", then the saved state
+		char header[66];
+		vector<uint8_t> data;
+		if (fread(header, 1, 65, f) == 65 && memcmp(header, keys[i].c_str(), 64) == 0 && header[64] == '\n') {
+			uint8_t buf[1 << 16];
+			size_t n;
+			while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+				data.insert(data.end(), buf, buf+n);
+		}
+		else {
+			data.clear();
+		}
+		bool ok = !ferror(f) && !data.empty();
+		fclose(f);
+		if (!ok)
+			break;
+		ByteReader reader(&data[0], data.size());
+		if (!img.loadCheckpoint((HandwrittenImage::CHECKPOINT)i, reader)) {
+			MsgPrint::msgPrint(MsgPrint::WARN, ("Ignoring damaged stage checkpoint " + fileName(i)).c_str());
+			break;
+		}
+		restored = i+1;
+	}
+	if (restored > 0) {
+		char msg[1000];
+		sprintf(msg, "Resuming after stage checkpoint %s ......", CHECKPOINTS[restored-1].name);
+		MsgPrint::msgPrint(MsgPrint::INFO, msg);
+	}
+	return restored;
+}
+
+// write to a temporary file first, a checkpoint is either complete or missing
+void StageCache::save(const HandwrittenImage &img, HandwrittenImage::CHECKPOINT ckpt) {
+	if (keys.empty())
+		return;
+	string name = fileName(ckpt), tmpName = name + ".tmp";
+	ByteWriter writer;
+	img.saveCheckpoint(ckpt, writer);
+	FILE *f = BatchRunner::makeDirs(dir) ? fopen(tmpName.c_str(), "wb") : NULL;
+	bool ok = (f != NULL);
+	if (ok) {
+		ok = fprintf(f, "%s\n", keys[ckpt].c_str()) == 65 &&
+		     fwrite(&writer.bytes[0], 1, writer.bytes.size(), f) == writer.bytes.size();
+		ok = (fclose(f) == 0) && ok;
+	}
+	if (!ok || rename(tmpName.c_str(), name.c_str()) != 0) {
+		remove(tmpName.c_str());
+		MsgPrint::msgPrint(MsgPrint::WARN, ("Cannot write stage checkpoint " + name).c_str());
+	}
+}
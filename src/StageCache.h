@@ -0,0 +1,34 @@
+#ifndef __STAGECACHE_H__
+#define __STAGECACHE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "HandwrittenImage.h"
+using std::map;
+using std::string;
+using std::vector;
+
+// on-disk checkpoints of the stage results of one page, so a rerun with changed configs resumes at the first affected stage
+// every checkpoint is a file <dir>/<n>-<name>.ckpt holding its key and the state saved by HandwrittenImage::saveCheckpoint
+// the key of a checkpoint is a SHA-256 over the key of the previous checkpoint and the configs its stages read,
+// the chain starts with the input image bytes, so a checkpoint is valid only if nothing it depends on has changed.
+// there is one file per checkpoint, a run with other configs replaces it.
+class StageCache {
+public:
+	// tiled, outputTypes: as set on the HandwrittenImage, they decide which planes are kept and thus saved
+	StageCache(const string &dir, const char *image, const map<string, double> &configs, bool tiled, uint32_t outputTypes);
+	// restore the longest run of valid checkpoints from the first one on, return the number of checkpoints restored
+	// img must be freshly read from the image the cache was built for
+	int restore(HandwrittenImage &img);
+	// save a checkpoint right after its stages ran, failing to write only costs a warning
+	void save(const HandwrittenImage &img, HandwrittenImage::CHECKPOINT ckpt);
+
+private:
+	string fileName(int ckpt) const;
+
+	string dir;
+	vector<string> keys;  // key of each checkpoint, empty if the image cannot be read
+};
+
+#endif
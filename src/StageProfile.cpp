@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "StageProfile.h"
+
+std::atomic<uint64_t> StageProfile::counters[StageProfile::COUNTER_COUNT];
+
+static const char *COUNTER_NAMES[StageProfile::COUNTER_COUNT] = {"fill_runs", "trace_steps", "chain_code_steps", "distance_calls"};
+
+static int64_t clockUs(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long currentRssKB() {
+	long pages = 0, rss = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+		rss = -1;
+	fclose(f);
+	return (rss < 0) ? -1 : rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long peakRssKB() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+// JSON string with quotes, control characters are escaped
+static string jsonString(const string &s) {
+	string res = "\"";
+	for (size_t i = 0; i < s.length(); ++i) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\') {
+			res += '\\';
+			res += c;
+		}
+		else if (c < 0x20) {
+			char buf[8];
+			sprintf(buf, "\\u%04x", c);
+			res += buf;
+		}
+		else {
+			res += c;
+		}
+	}
+	return res + "\"";
+}
+
+StageProfile::Scope::Scope(StageProfile *profile, const char *name) : span(name, "stage"), profile(profile), name(name) {
+	if (profile == NULL)
+		return;
+	wallUs = clockUs(CLOCK_MONOTONIC);
+	cpuUs = clockUs(CLOCK_PROCESS_CPUTIME_ID);
+	threadCpuUs = clockUs(CLOCK_THREAD_CPUTIME_ID);
+	for (int c = 0; c < COUNTER_COUNT; ++c)
+		work[c] = counters[c].load(std::memory_order_relaxed);
+	PerfCounters::attachThread();
+	PerfCounters::read(hardware);
+}
+
+StageProfile::Scope::~Scope() {
+	if (profile == NULL)
+		return;
+	Stage s;
+	PerfCounters::read(s.hardware);
+	// scaled counts of multiplexed events are estimates, they can seem to run backwards
+	for (int e = 0; e < PerfCounters::EVENT_COUNT; ++e)
+		s.hardware[e] = (s.hardware[e] > hardware[e]) ? s.hardware[e] - hardware[e] : 0;
+	for (int c = 0; c < COUNTER_COUNT; ++c)
+		s.work[c] = counters[c].load(std::memory_order_relaxed) - work[c];
+	s.name = name;
+	s.wallMs = (clockUs(CLOCK_MONOTONIC) - wallUs) / 1000.0;
+	s.cpuMs = (clockUs(CLOCK_PROCESS_CPUTIME_ID) - cpuUs) / 1000.0;
+	s.threadCpuMs = (clockUs(CLOCK_THREAD_CPUTIME_ID) - threadCpuUs) / 1000.0;
+	s.rssKB = currentRssKB();
+	s.peakRssKB = peakRssKB();
+	profile->stages.push_back(s);
+}
+
+void StageProfile::clear() {
+	image.clear();
+	prefix.clear();
+	width = height = charH = -1;
+	inkPixels = -1;
+	stages.clear();
+}
+
+bool StageProfile::writeJSON(const string &fileName) const {
+	FILE *f = fopen(fileName.c_str(), "w");
+	if (f == NULL)
+		return false;
+	double wallMs = 0, cpuMs = 0;
+	for (size_t i = 0; i < stages.size(); ++i) {
+		wallMs += stages[i].wallMs;
+		cpuMs += stages[i].cpuMs;
+	}
+	fprintf(f, "{\n");
+	fprintf(f, "  \"image\": %s,\n", jsonString(image).c_str());
+	fprintf(f, "  \"prefix\": %s,\n", jsonString(prefix).c_str());
+	fprintf(f, "  \"width\": %d,\n  \"height\": %d,\n  \"charH\": %d,\n  \"ink_pixels\": %lld,\n", width, height, charH, (long long)inkPixels);
+	fprintf(f, "  \"wall_ms\": %.3f,\n  \"cpu_ms\": %.3f,\n", wallMs, cpuMs);
+	fprintf(f, "  \"hardware_counters\": %s,\n", PerfCounters::enabled() ? "true" : "false");
+	fprintf(f, "  \"stages\": [");
+	double pixels = (double)width * height;
+	for (size_t i = 0; i < stages.size(); ++i) {
+		const Stage &s = stages[i];
+		fprintf(f, "%s\n    {\"name\": %s, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"thread_cpu_ms\": %.3f, \"rss_kb\": %ld, \"peak_rss_kb\": %ld",
+				(i == 0) ? "" : ",", jsonString(s.name).c_str(), s.wallMs, s.cpuMs, s.threadCpuMs, s.rssKB, s.peakRssKB);
+		for (int c = 0; c < COUNTER_COUNT; ++c)
+			fprintf(f, ", \"%s\": %llu", COUNTER_NAMES[c], (unsigned long long)s.work[c]);
+		if (inkPixels > 0)
+			fprintf(f, ", \"fill_runs_per_ink_pixel\": %.4f", s.work[FILL_RUNS] / (double)inkPixels);
+		// unavailable events are left out
+		for (int e = 0; e < PerfCounters::EVENT_COUNT; ++e) {
+			if (PerfCounters::available((PerfCounters::EVENT)e))
+				fprintf(f, ", \"%s\": %llu", PerfCounters::name((PerfCounters::EVENT)e), (unsigned long long)s.hardware[e]);
+		}
+		if (PerfCounters::available(PerfCounters::CYCLES) && PerfCounters::available(PerfCounters::INSTRUCTIONS) && s.hardware[PerfCounters::CYCLES] > 0)
+			fprintf(f, ", \"ipc\": %.3f", (double)s.hardware[PerfCounters::INSTRUCTIONS] / s.hardware[PerfCounters::CYCLES]);
+		if (PerfCounters::available(PerfCounters::LLC_MISSES) && pixels > 0)
+			fprintf(f, ", \"llc_misses_per_pixel\": %.4f", s.hardware[PerfCounters::LLC_MISSES] / pixels);
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n  ]\n}\n");
+	return fclose(f) == 0;
+}
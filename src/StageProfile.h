@@ -0,0 +1,69 @@
+#ifndef __STAGEPROFILE_H__
+#define __STAGEPROFILE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "Timeline.h"
+#include "PerfCounters.h"
+using std::string;
+using std::vector;
+
+// wall time, CPU time and memory of the stages of one page, written as JSON
+// cpu_ms is the CPU time of the whole process during a stage, it includes the thread pool workers,
+// and in a batch also the pages processed at the same time. thread_cpu_ms is the calling thread only.
+// the work and hardware counters are process wide like cpu_ms, a batch with one worker counts each page alone
+class StageProfile {
+public:
+	// algorithmic work, counted by the algorithms as they run
+	//   FILL_RUNS         runs filled by the span flood fills
+	//   TRACE_STEPS       points visited by space and text tracing
+	//   CHAIN_CODE_STEPS  codes of the component chain codes of slant correction
+	//   DISTANCE_CALLS    convex hull distances calculated, not taken from the cache
+	enum COUNTER {FILL_RUNS, TRACE_STEPS, CHAIN_CODE_STEPS, DISTANCE_CALLS, COUNTER_COUNT};
+	// algorithms add up locally and count once per call or task, the counter is shared by all threads
+	static void count(COUNTER counter, uint64_t n) { counters[counter].fetch_add(n, std::memory_order_relaxed); }
+
+	// records one stage from construction to destruction, does nothing if profile is NULL
+	// the stage is also a span of the timeline, if it is recording
+	class Scope {
+	public:
+		Scope(StageProfile *profile, const char *name);
+		~Scope();
+	private:
+		Timeline::Span span;
+		StageProfile *profile;
+		const char *name;
+		int64_t wallUs, cpuUs, threadCpuUs;
+		uint64_t work[COUNTER_COUNT], hardware[PerfCounters::EVENT_COUNT];
+	};
+
+	struct Stage {
+		string name;
+		double wallMs, cpuMs, threadCpuMs;
+		long rssKB, peakRssKB;  // resident memory at the end of the stage, and the process peak so far
+		uint64_t work[COUNTER_COUNT], hardware[PerfCounters::EVENT_COUNT];
+	};
+
+	StageProfile() { clear(); }
+	// forget all stages, for the next page
+	void clear();
+	void setPage(const string &image, const string &prefix) { this->image = image; this->prefix = prefix; }
+	void setSize(int width, int height, int charH) { this->width = width; this->height = height; this->charH = charH; }
+	void setInkPixels(int64_t inkPixels) { this->inkPixels = inkPixels; }
+	// return false if the file cannot be written
+	bool writeJSON(const string &fileName) const;
+	// stages in the order they finished
+	const vector<Stage> &getStages() const { return stages; }
+
+private:
+	static std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+	string image, prefix;
+	int width, height, charH;
+	int64_t inkPixels;  // black pixels of the input image
+	vector<Stage> stages;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <exception>
+#include "ThreadPool.h"
+#include "Timeline.h"
+#include "PerfCounters.h"
+
+using std::atomic;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::shared_ptr;
+using std::make_shared;
+using std::exception_ptr;
+using std::deque;
+
+ThreadPool::ThreadPool(int threadCnt) {
+	if (threadCnt <= 0)
+		threadCnt = std::max(1u, std::thread::hardware_concurrency());  // 0 if unknown
+	stopping = false;
+	// a thread that cannot be started throws, the threads started so far are joined first
+	try {
+		workers.reserve(threadCnt - 1);
+		for (int i = 1; i < threadCnt; ++i)
+			workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+	catch (...) {
+		stop();
+		throw;
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	stop();
+}
+
+void ThreadPool::stop() {
+	{
+		lock_guard<mutex> lock(mtx);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+void ThreadPool::workerLoop(int index) {
+	Timeline::setThreadName("pool worker " + std::to_string(index));
+	PerfCounters::attachThread();
+	while (true) {
+		function<void()> task;
+		{
+			unique_lock<mutex> lock(mtx);
+			cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())  // stopping
+				return;
+			task = tasks.front();
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+// a few chunks per thread, so that threads finishing early can pick up more work
+int ThreadPool::chunkCnt(int n) const {
+	int chunks = 4 * getThreadCnt();
+	return (n < chunks) ? n : chunks;
+}
+
+struct ThreadPool::LoopState {
+	int first, n, chunks;
+	const function<void(int, int)> *func;
+	atomic<int> nextChunk;
+	atomic<int> doneChunks;
+	exception_ptr error;
+	mutex mtx;
+	std::condition_variable cv;
+};
+
+// claim and run chunks until all chunks are claimed
+void ThreadPool::runLoop(LoopState &state) {
+	int c;
+	while ((c = state.nextChunk.fetch_add(1)) < state.chunks) {
+		try {
+			(*state.func)(state.first + (long)state.n*c/state.chunks, state.first + (long)state.n*(c+1)/state.chunks);
+		}
+		catch (...) {
+			lock_guard<mutex> lock(state.mtx);
+			if (!state.error)
+				state.error = std::current_exception();
+		}
+		if (state.doneChunks.fetch_add(1) + 1 == state.chunks) {
+			lock_guard<mutex> lock(state.mtx);
+			state.cv.notify_all();
+		}
+	}
+}
+
+void ThreadPool::parallelFor(int first, int last, const function<void(int, int)> &func) {
+	if (last <= first)
+		return;
+	if (workers.empty() || last - first == 1) {
+		func(first, last);
+		return;
+	}
+
+	// state is shared with helper tasks, which may start after the loop is done
+	shared_ptr<LoopState> state = make_shared<LoopState>();
+	state->first = first;
+	state->n = last - first;
+	state->chunks = chunkCnt(state->n);
+	state->func = &func;
+	state->nextChunk = 0;
+	state->doneChunks = 0;
+
+	int helpers = std::min((int)workers.size(), state->chunks - 1);
+	{
+		lock_guard<mutex> lock(mtx);
+		for (int i = 0; i < helpers; ++i) {
+			tasks.push([this, state]() { runLoop(*state); });
+		}
+	}
+	cv.notify_all();
+
+	runLoop(*state);
+	{
+		unique_lock<mutex> lock(state->mtx);
+		state->cv.wait(lock, [&state]() { return state->doneChunks == state->chunks; });
+	}
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
+
+struct ThreadPool::TaskState {
+	int taskCnt;
+	const function<void(int)> *func;
+	vector< deque<int> > queues;  // one per participating thread
+	std::unique_ptr<mutex[]> queueMtx;
+	atomic<int> nextQueue;  // queue of the next thread joining in
+	atomic<int> doneTasks;
+	exception_ptr error;
+	mutex mtx;
+	std::condition_variable cv;
+};
+
+// run tasks from the front of the own queue, then steal from the back of the other queues until all queues are empty
+void ThreadPool::workTasks(TaskState &state) {
+	int queueCnt = state.queues.size();
+	int own = state.nextQueue.fetch_add(1) % queueCnt;
+	while (true) {
+		int task = -1;
+		for (int k = 0; k < queueCnt && task == -1; ++k) {
+			int q = (own + k) % queueCnt;
+			lock_guard<mutex> lock(state.queueMtx[q]);
+			if (state.queues[q].empty())
+				continue;
+			if (k == 0) {
+				task = state.queues[q].front();
+				state.queues[q].pop_front();
+			}
+			else {
+				task = state.queues[q].back();
+				state.queues[q].pop_back();
+			}
+		}
+		// queues are never refilled, nothing is left to take
+		if (task == -1)
+			return;
+
+		try {
+			(*state.func)(task);
+		}
+		catch (...) {
+			lock_guard<mutex> lock(state.mtx);
+			if (!state.error)
+				state.error = std::current_exception();
+		}
+		if (state.doneTasks.fetch_add(1) + 1 == state.taskCnt) {
+			lock_guard<mutex> lock(state.mtx);
+			state.cv.notify_all();
+		}
+	}
+}
+
+void ThreadPool::runTasks(int taskCnt, const function<void(int)> &task) {
+	if (taskCnt <= 0)
+		return;
+	if (workers.empty() || taskCnt == 1) {
+		for (int i = 0; i < taskCnt; ++i)
+			task(i);
+		return;
+	}
+
+	// state is shared with helper tasks, which may start after all tasks are done
+	shared_ptr<TaskState> state = make_shared<TaskState>();
+	int queueCnt = std::min(getThreadCnt(), taskCnt);
+	state->taskCnt = taskCnt;
+	state->func = &task;
+	state->queues.resize(queueCnt);
+	state->queueMtx.reset(new mutex[queueCnt]);
+	for (int i = 0; i < taskCnt; ++i)
+		state->queues[i % queueCnt].push_back(i);
+	state->nextQueue = 0;
+	state->doneTasks = 0;
+
+	{
+		lock_guard<mutex> lock(mtx);
+		for (int i = 1; i < queueCnt; ++i) {
+			tasks.push([this, state]() { workTasks(*state); });
+		}
+	}
+	cv.notify_all();
+
+	workTasks(*state);
+	{
+		unique_lock<mutex> lock(state->mtx);
+		state->cv.wait(lock, [&state]() { return state->doneTasks == state->taskCnt; });
+	}
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
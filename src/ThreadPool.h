@@ -0,0 +1,72 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+using std::vector;
+using std::queue;
+using std::function;
+
+// a fixed size thread pool for data-parallel loops
+// the calling thread always takes part in the work, so parallel loops can be nested or issued from several threads
+class ThreadPool {
+public:
+	// threadCnt: total number of threads working on a parallel loop (including the caller), 0: one per hardware thread
+	ThreadPool(int threadCnt);
+	~ThreadPool();
+	int getThreadCnt() const { return workers.size() + 1; }
+
+	// call func(begin, end) on consecutive chunks of [first, last), return when all chunks are done
+	// exception thrown by func is rethrown in the calling thread
+	void parallelFor(int first, int last, const function<void(int, int)> &func);
+
+	// reduce consecutive chunks of [first, last) with func(begin, end), then combine chunk results from left to right
+	// result does not depend on the number of threads as long as chunk results are combined associatively
+	template <class T>
+	T parallelReduce(int first, int last, const T &init, const function<T(int, int)> &func, const function<T(const T&, const T&)> &combine);
+
+	// call task(i) for every i in [0, taskCnt), for independent tasks of uneven size, return when all tasks are done
+	// tasks are dealt to per-thread queues in index order, so put the largest tasks first
+	// a thread whose queue runs empty steals from the back of the other queues
+	// exception thrown by task is rethrown in the calling thread
+	void runTasks(int taskCnt, const function<void(int)> &task);
+
+private:
+	struct LoopState;
+	struct TaskState;
+	int chunkCnt(int n) const;
+	void runLoop(LoopState &state);
+	void workTasks(TaskState &state);
+	void workerLoop(int index);
+	// end and join the workers
+	void stop();
+
+	vector<std::thread> workers;
+	queue< function<void()> > tasks;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stopping;
+};
+
+template <class T>
+T ThreadPool::parallelReduce(int first, int last, const T &init, const function<T(int, int)> &func, const function<T(const T&, const T&)> &combine) {
+	if (last <= first)
+		return init;
+	int n = last - first;
+	int chunks = chunkCnt(n);
+	vector<T> partial(chunks, init);
+	parallelFor(0, chunks, [&](int cb, int ce) {
+		for (int c = cb; c < ce; ++c)
+			partial[c] = func(first + (long)n*c/chunks, first + (long)n*(c+1)/chunks);
+	});
+	T res = init;
+	for (int c = 0; c < chunks; ++c)
+		res = combine(res, partial[c]);
+	return res;
+}
+
+#endif
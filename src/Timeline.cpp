@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <set>
+#include "Timeline.h"
+
+using std::set;
+using std::shared_ptr;
+using std::lock_guard;
+using std::mutex;
+
+struct Timeline::Event {
+	char phase;  // 'X': span of one thread, 'b', 'e': begin and end of an async span
+	const char *name, *category, *detail;
+	int64_t id, beginUs, endUs;
+};
+
+struct Timeline::ThreadBuffer {
+	int tid;
+	string name;
+	vector<Event> events;  // ring buffer
+	uint64_t recorded;     // events recorded so far, the last min(recorded, capacity) are kept
+};
+
+std::atomic<bool> Timeline::on(false);
+vector< shared_ptr<Timeline::ThreadBuffer> > Timeline::buffers;
+thread_local Timeline::ThreadBuffer *Timeline::localBuffer = NULL;
+
+static mutex registryMtx;  // guards buffers, names of buffers and internedStrings
+static set<string> internedStrings;
+static size_t capacity = 1 << 16;
+static thread_local string localName;
+
+static int64_t nowUs() {
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Timeline::enable(size_t eventsPerThread) {
+	capacity = (eventsPerThread > 0) ? eventsPerThread : 1;
+	nowUs();
+	on = true;
+}
+
+Timeline::ThreadBuffer *Timeline::threadBuffer() {
+	if (localBuffer == NULL) {
+		shared_ptr<ThreadBuffer> buf(new ThreadBuffer());
+		buf->events.resize(capacity);
+		buf->recorded = 0;
+		buf->name = localName;
+		lock_guard<mutex> lock(registryMtx);
+		buf->tid = buffers.size() + 1;
+		buffers.push_back(buf);
+		localBuffer = buf.get();
+	}
+	return localBuffer;
+}
+
+void Timeline::setThreadName(const string &name) {
+	localName = name;
+	if (localBuffer != NULL) {
+		lock_guard<mutex> lock(registryMtx);
+		localBuffer->name = name;
+	}
+}
+
+const char *Timeline::intern(const string &s) {
+	lock_guard<mutex> lock(registryMtx);
+	return internedStrings.insert(s).first->c_str();
+}
+
+void Timeline::record(char phase, const char *name, const char *category, const char *detail, int64_t id, int64_t beginUs, int64_t endUs) {
+	ThreadBuffer *buf = threadBuffer();
+	Event &e = buf->events[buf->recorded % buf->events.size()];
+	e.phase = phase;
+	e.name = name;
+	e.category = category;
+	e.detail = detail;
+	e.id = id;
+	e.beginUs = beginUs;
+	e.endUs = endUs;
+	++buf->recorded;
+}
+
+Timeline::Span::Span(const char *name, const char *category, const char *detail, int64_t id)
+	: name(name), category(category), detail(detail), id(id) {
+	beginUs = enabled() ? nowUs() : -1;
+}
+
+Timeline::Span::~Span() {
+	if (beginUs >= 0)
+		record('X', name, category, detail, id, beginUs, nowUs());
+}
+
+void Timeline::asyncBegin(const char *name, const char *category, const char *detail, int64_t id) {
+	if (enabled()) {
+		int64_t t = nowUs();
+		record('b', name, category, detail, id, t, t);
+	}
+}
+
+void Timeline::asyncEnd(const char *name, const char *category, const char *detail, int64_t id) {
+	if (enabled()) {
+		int64_t t = nowUs();
+		record('e', name, category, detail, id, t, t);
+	}
+}
+
+// JSON string with quotes, control characters are escaped
+static void writeString(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s != '\0'; ++s) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+bool Timeline::write(const string &fileName) {
+	FILE *f = fopen(fileName.c_str(), "w");
+	if (f == NULL)
+		return false;
+	int pid = 1;
+	lock_guard<mutex> lock(registryMtx);
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool first = true;
+	uint64_t dropped = 0;
+	for (size_t b = 0; b < buffers.size(); ++b) {
+		const ThreadBuffer &buf = *buffers[b];
+		fprintf(f, "%s{\"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": ", first ? "" : ",\n", pid, buf.tid);
+		writeString(f, buf.name.empty() ? "thread" : buf.name.c_str());
+		fprintf(f, "}}");
+		first = false;
+
+		uint64_t n = buf.events.size();
+		uint64_t st = (buf.recorded > n) ? buf.recorded - n : 0;
+		dropped += st;
+		for (uint64_t k = st; k < buf.recorded; ++k) {
+			const Event &e = buf.events[k % n];
+			fprintf(f, ",\n{\"ph\": \"%c\", \"pid\": %d, \"tid\": %d, \"ts\": %lld, ", e.phase, pid, buf.tid, (long long)e.beginUs);
+			if (e.phase == 'X')
+				fprintf(f, "\"dur\": %lld, ", (long long)(e.endUs - e.beginUs));
+			else
+				fprintf(f, "\"id\": %lld, ", (long long)e.id);
+			fprintf(f, "\"name\": ");
+			writeString(f, e.name);
+			fprintf(f, ", \"cat\": ");
+			writeString(f, e.category);
+			if (e.detail != NULL || (e.phase == 'X' && e.id >= 0)) {
+				fprintf(f, ", \"args\": {");
+				if (e.detail != NULL) {
+					fprintf(f, "\"detail\": ");
+					writeString(f, e.detail);
+				}
+				if (e.phase == 'X' && e.id >= 0)
+					fprintf(f, "%s\"id\": %lld", (e.detail != NULL) ? ", " : "", (long long)e.id);
+				fprintf(f, "}");
+			}
+			fprintf(f, "}");
+		}
+	}
+	fprintf(f, "\n], \"otherData\": {\"droppedEvents\": %llu}}\n", (unsigned long long)dropped);
+	return fclose(f) == 0;
+}
@@ -0,0 +1,57 @@
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+using std::string;
+using std::vector;
+
+// records spans of work per thread and writes them in the Chrome trace event format (chrome://tracing, Perfetto)
+// every thread records into its own ring buffer without locking, when a buffer is full its oldest events are dropped.
+// recording costs one relaxed atomic load per span while the timeline is off.
+// names, categories and details must outlive the timeline: string literals, or strings from intern
+class Timeline {
+public:
+	// start recording, eventsPerThread: ring buffer capacity of each thread
+	// must be called before the threads to be recorded start working
+	static void enable(size_t eventsPerThread = 1 << 16);
+	static bool enabled() { return on.load(std::memory_order_relaxed); }
+	// name shown for the calling thread
+	static void setThreadName(const string &name);
+	// a copy of s that lives until the process exits, for page names and other details of spans
+	static const char *intern(const string &s);
+	// write all recorded events, the recording threads must be idle
+	// return false if the file cannot be written
+	static bool write(const string &fileName);
+
+	// the time from construction to destruction is a span of the calling thread
+	// detail and id are shown as arguments of the span, id < 0: none
+	class Span {
+	public:
+		Span(const char *name, const char *category, const char *detail = NULL, int64_t id = -1);
+		~Span();
+	private:
+		const char *name, *category, *detail;
+		int64_t id, beginUs;
+	};
+
+	// a span that begins and ends in different threads, e.g. a page going through the pipeline, id tells spans apart
+	static void asyncBegin(const char *name, const char *category, const char *detail, int64_t id);
+	static void asyncEnd(const char *name, const char *category, const char *detail, int64_t id);
+
+private:
+	struct Event;
+	struct ThreadBuffer;
+	static ThreadBuffer *threadBuffer();
+	static void record(char phase, const char *name, const char *category, const char *detail, int64_t id, int64_t beginUs, int64_t endUs);
+
+	static std::atomic<bool> on;
+	// buffers stay registered after their threads exit, so pipeline threads that are done are still written
+	static vector< std::shared_ptr<ThreadBuffer> > buffers;
+	static thread_local ThreadBuffer *localBuffer;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include "TraceMap.h"
+#include "ByteStream.h"
+
+using std::lower_bound;
+using std::make_pair;
+
+void TraceMap::reset(int width) {
+	traces.clear();
+	columns.assign(width, vector< pair<int, int> >());
+}
+
+void TraceMap::swap(TraceMap &other) {
+	traces.swap(other.traces);
+	columns.swap(other.columns);
+}
+
+void TraceMap::begin(int label) {
+	// a trace stopped before its first point is reused
+	if (traces.empty() || !traces.back().ys.empty())
+		traces.push_back(Trace());
+	Trace &t = traces.back();
+	t.label = label;
+	t.x0 = 0;
+	t.dx = 1;
+}
+
+void TraceMap::add(int x, int y) {
+	Trace &t = traces.back();
+	if (t.ys.empty())
+		t.x0 = x;
+	else if (t.ys.size() == 1)
+		t.dx = (x > t.x0) ? 1 : -1;
+	t.ys.push_back(y);
+	index(x, y, t.label);
+}
+
+void TraceMap::index(int x, int y, int label) {
+	vector< pair<int, int> > &col = columns[x];
+	vector< pair<int, int> >::iterator it = lower_bound(col.begin(), col.end(), make_pair(y, 0),
+			[](const pair<int, int> &a, const pair<int, int> &b) { return a.first < b.first; });
+	if (it != col.end() && it->first == y)
+		it->second = label;
+	else
+		col.insert(it, make_pair(y, label));
+}
+
+int TraceMap::at(int x, int y) const {
+	const vector< pair<int, int> > &col = columns[x];
+	vector< pair<int, int> >::const_iterator it = lower_bound(col.begin(), col.end(), make_pair(y, 0),
+			[](const pair<int, int> &a, const pair<int, int> &b) { return a.first < b.first; });
+	return (it != col.end() && it->first == y) ? it->second : 0;
+}
+
+bool TraceMap::passes(int x, int yl, int yh, int label) const {
+	const vector< pair<int, int> > &col = columns[x];
+	vector< pair<int, int> >::const_iterator it = lower_bound(col.begin(), col.end(), make_pair(yl, 0),
+			[](const pair<int, int> &a, const pair<int, int> &b) { return a.first < b.first; });
+	for (; it != col.end() && it->first <= yh; ++it) {
+		if (it->second == label)
+			return true;
+	}
+	return false;
+}
+
+vector< vector<int32_t> > TraceMap::toPlane(int height) const {
+	vector< vector<int32_t> > pix(columns.size(), vector<int32_t>(height, 0));
+	for (size_t x = 0; x < columns.size(); ++x) {
+		for (size_t i = 0; i < columns[x].size(); ++i)
+			pix[x][columns[x][i].first] = columns[x][i].second;
+	}
+	return pix;
+}
+
+void TraceMap::save(ByteWriter &writer) const {
+	// a trace stopped before its first point is not saved
+	size_t n = 0;
+	for (size_t i = 0; i < traces.size(); ++i)
+		n += traces[i].ys.empty() ? 0 : 1;
+	writer.putUint(columns.size());
+	writer.putUint(n);
+	for (size_t i = 0; i < traces.size(); ++i) {
+		const Trace &t = traces[i];
+		if (t.ys.empty())
+			continue;
+		writer.putInt(t.label);
+		writer.putInt(t.x0);
+		writer.putInt(t.dx);
+		writer.putUint(t.ys.size());
+		// a trace moves at most one row per column, the differences fit in a byte
+		int last = 0;
+		for (size_t k = 0; k < t.ys.size(); ++k) {
+			writer.putInt(t.ys[k] - last);
+			last = t.ys[k];
+		}
+	}
+}
+
+bool TraceMap::load(ByteReader &reader, int width, int height) {
+	if (reader.getUint() != (uint64_t)width)
+		return false;
+	reset(width);
+	size_t n = reader.getUint();
+	for (size_t i = 0; i < n && !reader.failed; ++i) {
+		begin(reader.getInt());
+		Trace &t = traces.back();
+		int x0 = reader.getInt(), dx = reader.getInt();
+		size_t len = reader.getUint();
+		if (reader.failed || (dx != 1 && dx != -1) || len == 0 || len > (size_t)width ||
+				x0 < 0 || x0 >= width || x0 + (int)(len-1)*dx < 0 || x0 + (int)(len-1)*dx >= width)
+			return false;
+		int y = 0;
+		for (size_t k = 0; k < len; ++k) {
+			y += reader.getInt();
+			if (y < 0 || y >= height)
+				return false;
+			add(x0 + (int)k*dx, y);
+		}
+		t.dx = dx;
+	}
+	return !reader.failed;
+}
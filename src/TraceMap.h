@@ -0,0 +1,63 @@
+#ifndef __TRACEMAP_H__
+#define __TRACEMAP_H__
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+using std::vector;
+using std::pair;
+
+class ByteWriter;
+class ByteReader;
+
+// labeled traces over a page, stored as polylines instead of a width x height plane
+// a trace runs column by column from its first point to the left or to the right, with one y per column
+// traced points are also kept in a per-column index sorted by y, to look up what was traced at a point
+class TraceMap {
+public:
+	TraceMap() {}
+	// remove all traces, the page has width columns
+	void reset(int width);
+	void swap(TraceMap &other);
+
+	// start a trace, its points are added in the order they are traced
+	void begin(int label);
+	// add a point to the current trace, at most one trace may pass a point
+	void add(int x, int y);
+
+	// label of the trace passing (x, y), 0 if none
+	int at(int x, int y) const;
+	// whether a trace with label passes column x between rows yl and yh
+	bool passes(int x, int yl, int yh, int label) const;
+	// visit all traced points, func(x, y, label)
+	template <class F>
+	void forEach(F func) const;
+	// the traces drawn into a width x height plane, 0 where no trace passes, for output
+	vector< vector<int32_t> > toPlane(int height) const;
+
+	void save(ByteWriter &writer) const;
+	// return false if the data is malformed
+	bool load(ByteReader &reader, int width, int height);
+
+private:
+	struct Trace {
+		int label;
+		int x0, dx;  // first column, and +1 or -1 for a trace to the right or to the left
+		vector<int> ys;  // y in columns x0, x0+dx, ...
+	};
+	void index(int x, int y, int label);
+
+	vector<Trace> traces;
+	vector< vector< pair<int, int> > > columns;  // (y, label) of the traced points of each column, sorted by y
+};
+
+template <class F>
+void TraceMap::forEach(F func) const {
+	for (size_t i = 0; i < traces.size(); ++i) {
+		const Trace &t = traces[i];
+		for (size_t k = 0; k < t.ys.size(); ++k)
+			func(t.x0 + (int)k*t.dx, t.ys[k], t.label);
+	}
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "WorkQueue.h"
+#include "MsgPrint.h"
+
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+using std::min;
+using std::max;
+
+WorkQueue::WorkQueue(const string &dir, const vector<PageJob> &jobs, int leaseTimeout) : jobs(jobs) {
+	char msg[1000];
+	string base = (dir[dir.length()-1] == '/') ? dir : dir + "/";
+	leaseDir = base + "leases/";
+	journalDir = base + "journal/";
+	if (!BatchRunner::makeDirs(leaseDir) || !BatchRunner::makeDirs(journalDir)) {
+		sprintf(msg, "Cannot create work queue directory %s.", dir.c_str());
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+
+	char host[256];
+	if (gethostname(host, sizeof(host)) != 0)
+		sprintf(host, "localhost");
+	host[sizeof(host)-1] = '\0';
+	sprintf(msg, "%s-%d", host, (int)getpid());
+	owner = msg;
+	this->leaseTimeout = max(leaseTimeout, 1);
+
+	for (size_t i = 0; i < jobs.size(); ++i)
+		keys.push_back(pageKey(jobs[i]));
+
+	journal = fopen((journalDir + owner + ".log").c_str(), "a");
+	if (journal == NULL) {
+		sprintf(msg, "Cannot open journal in work queue %s.", dir.c_str());
+		MsgPrint::msgPrint(MsgPrint::ERR, msg);
+	}
+	readJournals();
+	size_t finishedCnt = 0;
+	for (size_t i = 0; i < keys.size(); ++i)
+		finishedCnt += finished.count(keys[i]);
+	sprintf(msg, "Work queue %s: %zu of %zu pages already finished.", dir.c_str(), finishedCnt, jobs.size());
+	MsgPrint::msgPrint(MsgPrint::INFO, msg);
+
+	cursor = 0;
+	start = jobs.empty() ? 0 : std::hash<string>()(owner) % jobs.size();
+	stopping = false;
+	heartbeat = std::thread(&WorkQueue::heartbeatLoop, this);
+}
+
+WorkQueue::~WorkQueue() {
+	{
+		lock_guard<mutex> lock(mtx);
+		stopping = true;
+	}
+	cv.notify_all();
+	heartbeat.join();
+
+	// pages claimed but never finished are given back right away
+	while (!held.empty())
+		releaseLease(*held.begin());
+	fclose(journal);
+}
+
+// file name safe key of a page, FNV-1a hash of its output location
+string WorkQueue::pageKey(const PageJob &job) {
+	string name = job.outdir + job.prefix;
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < name.length(); ++i) {
+		h ^= (uint8_t)name[i];
+		h *= 1099511628211ULL;
+	}
+	char key[17];
+	sprintf(key, "%016llx", (unsigned long long)h);
+	return key;
+}
+
+// read journal lines appended since the last call, a line still being written is read next time
+void WorkQueue::readJournals() {
+	DIR *d = opendir(journalDir.c_str());
+	if (d == NULL)
+		return;
+	char *line = NULL;
+	size_t cap = 0;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		string name = entry->d_name;
+		if (name.length() < 4 || name.substr(name.length()-4) != ".log")
+			continue;
+		FILE *f = fopen((journalDir + name).c_str(), "r");
+		if (f == NULL)
+			continue;
+		long &offset = journalOffsets[name];
+		fseek(f, offset, SEEK_SET);
+		ssize_t len;
+		while ((len = getline(&line, &cap, f)) > 0 && line[len-1] == '\n') {
+			offset += len;
+			char status[16], key[32];
+			if (sscanf(line, "%15s %31s", status, key) == 2)
+				finished.insert(key);
+		}
+		fclose(f);
+	}
+	free(line);
+	closedir(d);
+}
+
+// called with mtx held
+bool WorkQueue::acquireLease(size_t index) {
+	char msg[1000];
+	string path = leaseDir + keys[index] + ".lease";
+	for (int attempt = 0; attempt < 3; ++attempt) {
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd >= 0) {
+			string content = owner + " " + jobs[index].image + "\n";
+			if (write(fd, content.c_str(), content.length()) < 0) {
+				// the lease is held by the file itself, its content is informational only
+			}
+			close(fd);
+			// the page may have been finished by another process since the journals were read
+			readJournals();
+			held.insert(index);
+			if (finished.count(keys[index])) {
+				releaseLease(index);
+				return false;
+			}
+			return true;
+		}
+		if (errno != EEXIST) {
+			sprintf(msg, "Cannot create lease %s.", path.c_str());
+			MsgPrint::msgPrint(MsgPrint::WARN, msg);
+			return false;
+		}
+
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+			continue;  // released in the meantime
+		if (time(NULL) - st.st_mtime < leaseTimeout)
+			return false;
+
+		// the owner stopped its heartbeat, take the lease over
+		// if the moved lease turns out to be fresh, another process took it over first, put it back
+		string expired = path + "." + owner;
+		if (rename(path.c_str(), expired.c_str()) != 0)
+			continue;
+		if (stat(expired.c_str(), &st) == 0 && time(NULL) - st.st_mtime < leaseTimeout) {
+			if (link(expired.c_str(), path.c_str()) != 0) {
+				// a third process created the lease again, the page is processed twice at worst
+			}
+			unlink(expired.c_str());
+			return false;
+		}
+		unlink(expired.c_str());
+		sprintf(msg, "Lease of page %s expired, taking it over.", jobs[index].image.c_str());
+		MsgPrint::msgPrint(MsgPrint::WARN, msg);
+	}
+	return false;
+}
+
+// called with mtx held
+void WorkQueue::releaseLease(size_t index) {
+	unlink((leaseDir + keys[index] + ".lease").c_str());
+	held.erase(index);
+}
+
+bool WorkQueue::next(size_t &index) {
+	unique_lock<mutex> lock(mtx);
+	size_t n = jobs.size();
+	// first pass over all pages, pages leased by other processes are retried later
+	while (cursor < n) {
+		size_t i = (start + cursor++) % n;
+		if (finished.count(keys[i]))
+			continue;
+		if (acquireLease(i)) {
+			index = i;
+			return true;
+		}
+		busy.insert(i);
+	}
+
+	// wait until the busy pages are finished by their owners, or their leases expire
+	int pollInterval = min(max(leaseTimeout/10, 1), 10);
+	while (!busy.empty()) {
+		readJournals();
+		for (set<size_t>::iterator it = busy.begin(); it != busy.end(); ) {
+			size_t i = *it;
+			if (finished.count(keys[i])) {
+				busy.erase(it++);
+				continue;
+			}
+			if (acquireLease(i)) {
+				busy.erase(it);
+				index = i;
+				return true;
+			}
+			++it;
+		}
+		if (!busy.empty()) {
+			lock.unlock();
+			std::this_thread::sleep_for(std::chrono::seconds(pollInterval));
+			lock.lock();
+		}
+	}
+	return false;
+}
+
+void WorkQueue::finish(size_t index, const string &error) {
+	lock_guard<mutex> lock(mtx);
+	// the journal line is durable before the lease is gone, so a page is always either leased or finished
+	fprintf(journal, "%s %s %s\n", error.empty() ? "done" : "failed", keys[index].c_str(), jobs[index].image.c_str());
+	fflush(journal);
+	fsync(fileno(journal));
+	finished.insert(keys[index]);
+	releaseLease(index);
+}
+
+void WorkQueue::heartbeatLoop() {
+	unique_lock<mutex> lock(mtx);
+	int interval = max(leaseTimeout/3, 1);
+	while (!cv.wait_for(lock, std::chrono::seconds(interval), [this] { return stopping; })) {
+		for (set<size_t>::iterator it = held.begin(); it != held.end(); ++it)
+			utimes((leaseDir + keys[*it] + ".lease").c_str(), NULL);
+	}
+}
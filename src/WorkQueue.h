@@ -0,0 +1,62 @@
+#ifndef __WORKQUEUE_H__
+#define __WORKQUEUE_H__
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "BatchRunner.h"
+using std::string;
+using std::vector;
+using std::set;
+using std::map;
+using std::unordered_set;
+
+// a work queue of pages kept in a directory, shared by any number of batch processes on one or more nodes
+//   <dir>/leases/<key>.lease    a page is being processed, created exclusively, its mtime is refreshed as a heartbeat
+//   <dir>/journal/<owner>.log   pages finished by a process, one "done|failed <key> <image>" line per page
+// a page is taken by creating its lease, a lease whose mtime is older than the lease timeout is taken over,
+// so pages of a crashed process are picked up again. pages in any journal are skipped, so a restart resumes the batch.
+// failed pages count as finished, remove their journal lines to retry them.
+// in the rare case that two processes take over the same expired lease, the page is processed twice with the same result.
+class WorkQueue : public PageSource {
+public:
+	// leaseTimeout: seconds, must be well above the time between heartbeats and the clock skew between nodes
+	WorkQueue(const string &dir, const vector<PageJob> &jobs, int leaseTimeout);
+	~WorkQueue();
+
+	bool next(size_t &index);
+	void finish(size_t index, const string &error);
+
+private:
+	static string pageKey(const PageJob &job);
+	bool acquireLease(size_t index);
+	void releaseLease(size_t index);
+	void readJournals();
+	void heartbeatLoop();
+
+	const vector<PageJob> &jobs;
+	vector<string> keys;  // lease and journal key of each page
+	string leaseDir, journalDir;
+	string owner;  // host and pid of this process
+	int leaseTimeout;
+	FILE *journal;  // journal of this process
+
+	size_t cursor;   // pages [0, cursor) of the claiming order have been tried
+	size_t start;    // processes start claiming at different pages of the list, to avoid contending for the same leases
+	set<size_t> busy;  // pages leased by other processes when they were tried, retried at the end
+	unordered_set<string> finished;  // keys of finished pages in all journals
+	map<string, long> journalOffsets;  // bytes of each journal read so far
+
+	std::mutex mtx;
+	set<size_t> held;  // pages leased by this process
+	bool stopping;
+	std::condition_variable cv;
+	std::thread heartbeat;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "HandwrittenImage.h"
+#include "ConfigParser.h"
+#include "ThreadPool.h"
+#include "PageProcessor.h"
+#include "BatchRunner.h"
+#include "PageGenerator.h"
+#include "MsgPrint.h"
+
+using std::string;
+using std::map;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::ifstream;
+using std::istringstream;
+
+static void usage() {
+	fprintf (stderr, "Usage: engine_bench <config> <report> [<name>=<value>[,<value> ...] ...]\n");
+	fprintf (stderr, "       engine_bench --page <image> [<name>=<value> ...]\n");
+	fprintf (stderr, "       engine_bench --compare <old report> <new report>\n");
+}
+
+// "<name>=<value>[,<value> ...]" arguments, in order
+static vector< pair<string, vector<double> > > parseArgs(int argc, char *argv[]) {
+	vector< pair<string, vector<double> > > args;
+	for (int i = 0; i < argc; ++i) {
+		const char *eq = strchr(argv[i], '=');
+		if (eq == NULL || eq == argv[i]) {
+			fprintf (stderr, "Error: Expected <name>=<value>, got %s.\n", argv[i]);
+			usage();
+			exit(1);
+		}
+		vector<double> values;
+		istringstream ss(eq + 1);
+		string v;
+		while (getline(ss, v, ','))
+			values.push_back(atof(v.c_str()));
+		if (values.empty()) {
+			fprintf (stderr, "Error: No value for %s.\n", argv[i]);
+			exit(1);
+		}
+		args.push_back(make_pair(string(argv[i], eq - argv[i]), values));
+	}
+	return args;
+}
+
+// changes whenever the words found change, so a report shows whether two commits segment alike
+static uint64_t wordHash(const HandwrittenImage &img) {
+	uint64_t h = 14695981039346656037ULL;
+	const vector<HandwrittenImage::WordBBox> &boxes = img.getWordBoxes();
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		int v[6] = {boxes[i].wordID, boxes[i].regionID, boxes[i].xl, boxes[i].xh, boxes[i].yl, boxes[i].yh};
+		for (int k = 0; k < 6; ++k)
+			h = (h ^ (uint32_t)v[k]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+static double median(vector<double> v) {
+	sort(v.begin(), v.end());
+	return v.empty() ? 0 : (v.size() % 2) ? v[v.size()/2] : (v[v.size()/2-1] + v[v.size()/2]) / 2;
+}
+
+// time every stage on synthetic pages, one page per point of the cartesian product of the listed generator parameters
+// report: tab separated, one line per page and stage, the median and minimum wall time over the repetitions
+static int bench(const char *configFile, const char *reportFile, const vector< pair<string, vector<double> > > &args) {
+	ConfigParser configParser(configFile);
+	map<string, double> configs = configParser.getConfigs();
+	// every repetition runs all stages
+	configs["stage_cache"] = 0;
+	ThreadPool threadPool(configs["threads"]);
+
+	int repeat = 3;
+	vector< pair<string, vector<double> > > grid;
+	grid.push_back(make_pair(string("dpi"), vector<double>{150, 300}));
+	grid.push_back(make_pair(string("density"), vector<double>{0.5, 1, 2}));
+	for (size_t i = 0; i < args.size(); ++i) {
+		if (args[i].first == "repeat") {
+			repeat = std::max(1, (int)args[i].second[0]);
+			continue;
+		}
+		size_t k = 0;
+		while (k < grid.size() && grid[k].first != args[i].first)
+			++k;
+		if (k == grid.size())
+			grid.push_back(args[i]);
+		else
+			grid[k].second = args[i].second;
+	}
+
+	string pageDir = string(reportFile) + "_pages/";
+	if (!BatchRunner::makeDirs(pageDir))
+		MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot create directory " + pageDir).c_str());
+	FILE *report = fopen(reportFile, "w");
+	if (report == NULL)
+		MsgPrint::msgPrint(MsgPrint::ERR, (string("Cannot write bench report ") + reportFile).c_str());
+	fprintf(report, "# config %s, threads %g, repeat %d\n", configFile, configs["threads"], repeat);
+	fprintf(report, "page\twidth\theight\tink_pixels\tcharH\twords\tword_hash\tstage\tmedian_ms\tmin_ms\n");
+
+	// the first parameter of the grid varies slowest
+	size_t cells = 1;
+	for (size_t k = 0; k < grid.size(); ++k)
+		cells *= grid[k].second.size();
+	HandwrittenImage img;
+	img.setThreadPool(&threadPool);
+	for (size_t c = 0; c < cells; ++c) {
+		map<string, double> params;
+		string page, prefix;
+		for (size_t k = grid.size(), rest = c; k-- > 0; rest /= grid[k].second.size()) {
+			double v = grid[k].second[rest % grid[k].second.size()];
+			params[grid[k].first] = v;
+			char buf[64];
+			snprintf(buf, sizeof(buf), "%s=%g", grid[k].first.c_str(), v);
+			page = string(buf) + (page.empty() ? string() : "," + page);
+			snprintf(buf, sizeof(buf), "%s%g", grid[k].first.c_str(), v);
+			prefix = string(buf) + (prefix.empty() ? string() : "_" + prefix);
+		}
+		PageJob job;
+		job.image = pageDir + prefix + ".bmp";
+		job.outdir = pageDir + prefix + "/";
+		job.prefix = prefix;
+		PageGenerator generator(params);
+		if (!generator.write(job.image))
+			MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot write page " + job.image).c_str());
+		if (!BatchRunner::makeDirs(job.outdir))
+			MsgPrint::msgPrint(MsgPrint::ERR, ("Cannot create directory " + job.outdir).c_str());
+		MsgPrint::msgPrint(MsgPrint::INFO, ("Benchmarking " + page + " ......").c_str());
+
+		// wall time of every stage in every repetition, stages in the order of the first repetition
+		vector<string> stages;
+		map<string, vector<double> > times;
+		StageProfile profile;
+		int64_t inkPixels = 0;
+		for (int r = 0; r < repeat; ++r) {
+			readPage(img, job, false, &profile);
+			inkPixels = img.countInkPixels();
+			segmentPage(img, job, configs, &profile);
+			writePageOutputs(img, job, false, &profile);
+			double total = 0;
+			const vector<StageProfile::Stage> &s = profile.getStages();
+			for (size_t i = 0; i < s.size(); ++i) {
+				if (times.count(s[i].name) == 0)
+					stages.push_back(s[i].name);
+				times[s[i].name].push_back(s[i].wallMs);
+				total += s[i].wallMs;
+			}
+			times["total"].push_back(total);
+		}
+		stages.push_back("total");
+		for (size_t i = 0; i < stages.size(); ++i) {
+			const vector<double> &t = times[stages[i]];
+			fprintf(report, "%s\t%d\t%d\t%lld\t%d\t%zu\t%016llx\t%s\t%.3f\t%.3f\n", page.c_str(), img.getWidth(), img.getHeight(),
+					(long long)inkPixels, img.getCharH(), img.getWordBoxes().size(), (unsigned long long)wordHash(img),
+					stages[i].c_str(), median(t), *std::min_element(t.begin(), t.end()));
+		}
+		fflush(report);
+	}
+	fclose(report);
+	return 0;
+}
+
+struct BenchLine {
+	string words, hash;
+	double medianMs;
+};
+
+// (page, stage) -> line, and the order of the keys
+static map< pair<string, string>, BenchLine > readReport(const char *fileName, vector< pair<string, string> > &order) {
+	ifstream f(fileName);
+	if (!f.is_open())
+		MsgPrint::msgPrint(MsgPrint::ERR, (string("Cannot open bench report ") + fileName).c_str());
+	map< pair<string, string>, BenchLine > lines;
+	string line;
+	while (getline(f, line)) {
+		if (line.empty() || line[0] == '#' || line.compare(0, 5, "page\t") == 0)
+			continue;
+		vector<string> cols;
+		istringstream ss(line);
+		string col;
+		while (getline(ss, col, '\t'))
+			cols.push_back(col);
+		if (cols.size() < 10)
+			continue;
+		BenchLine b;
+		b.words = cols[5];
+		b.hash = cols[6];
+		b.medianMs = atof(cols[8].c_str());
+		pair<string, string> key(cols[0], cols[7]);
+		if (lines.count(key) == 0)
+			order.push_back(key);
+		lines[key] = b;
+	}
+	return lines;
+}
+
+// median time of every stage in both reports, and pages whose words differ
+static int compare(const char *oldFile, const char *newFile) {
+	vector< pair<string, string> > order, oldOrder;
+	map< pair<string, string>, BenchLine > oldLines = readReport(oldFile, oldOrder);
+	map< pair<string, string>, BenchLine > newLines = readReport(newFile, order);
+	printf("%-32s %-28s %10s %10s %8s\n", "page", "stage", "old_ms", "new_ms", "change");
+	int differing = 0;
+	for (size_t i = 0; i < order.size(); ++i) {
+		if (oldLines.count(order[i]) == 0)
+			continue;
+		const BenchLine &o = oldLines[order[i]], &n = newLines[order[i]];
+		double change = (o.medianMs > 0) ? (n.medianMs / o.medianMs - 1) * 100 : 0;
+		printf("%-32s %-28s %10.3f %10.3f %+7.1f%%\n", order[i].first.c_str(), order[i].second.c_str(), o.medianMs, n.medianMs, change);
+		if (order[i].second == "total" && (o.words != n.words || o.hash != n.hash)) {
+			printf("%-32s words differ: %s %s, %s %s\n", order[i].first.c_str(), o.words.c_str(), o.hash.c_str(), n.words.c_str(), n.hash.c_str());
+			++differing;
+		}
+	}
+	return (differing == 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc >= 3 && strcmp(argv[1], "--page") == 0) {
+		vector< pair<string, vector<double> > > args = parseArgs(argc-3, argv+3);
+		map<string, double> params;
+		for (size_t i = 0; i < args.size(); ++i)
+			params[args[i].first] = args[i].second[0];
+		PageGenerator generator(params);
+		if (!generator.write(argv[2])) {
+			fprintf (stderr, "Error: Cannot write %s.\n", argv[2]);
+			return 1;
+		}
+		return 0;
+	}
+	if (argc == 4 && strcmp(argv[1], "--compare") == 0)
+		return compare(argv[2], argv[3]);
+	if (argc < 3 || argv[1][0] == '-') {
+		usage();
+		return 1;
+	}
+	return bench(argv[1], argv[2], parseArgs(argc-3, argv+3));
+}
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using std::string;
+using std::vector;
+
+// a client of engine --serve for local testing: sends one page and prints the daemon's response,
+// mask bytes are counted, not printed
+
+static void usage() {
+	fprintf (stderr, "Usage: engine_client <address> <image> [masks=<masks>] [<config>=<value> ...]\n");
+	fprintf (stderr, "       engine_client <address> --stats\n");
+}
+
+// one byte per pixel, rows from the top, 1 for black
+static bool readOneBitBMP(const char *fileName, vector<uint8_t> &pixels, int &width, int &height) {
+	FILE *f = fopen(fileName, "rb");
+	if (f == NULL)
+		return false;
+	uint8_t header[62];
+	bool ok = (fread(header, 1, 62, f) == 62);
+	width = *(int32_t*)&header[18];
+	height = *(int32_t*)&header[22];
+	uint32_t offset = *(uint32_t*)&header[10];
+	ok = ok && *(uint16_t*)&header[0] == 0x4D42 && *(uint16_t*)&header[28] == 1 && width > 0 && height > 0;
+	// lines are aligned on 4-byte boundary and stored from bottom to top, in BMP 1->white 0->black
+	uint32_t lineSize = (width + 31) / 32 * 4;
+	vector<uint8_t> data(ok ? (size_t)lineSize * height : 0);
+	ok = ok && fseek(f, offset, SEEK_SET) == 0 && fread(data.data(), 1, data.size(), f) == data.size();
+	fclose(f);
+	if (!ok)
+		return false;
+	pixels.resize((size_t)width * height);
+	for (int y = 0; y < height; ++y) {
+		const uint8_t *row = &data[(size_t)(height-1-y) * lineSize];
+		for (int x = 0; x < width; ++x)
+			pixels[(size_t)y * width + x] = (row[x/8] >> (7 - x%8)) & 1 ? 0 : 1;
+	}
+	return true;
+}
+
+static int connectTo(const string &address) {
+	bool tcp = !address.empty() && address.find_first_not_of("0123456789") == string::npos;
+	int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+	int status = -1;
+	if (fd >= 0 && tcp) {
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(atoi(address.c_str()));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		status = connect(fd, (sockaddr *)&addr, sizeof(addr));
+	}
+	else if (fd >= 0 && address.size() < sizeof(sockaddr_un().sun_path)) {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, address.c_str());
+		status = connect(fd, (sockaddr *)&addr, sizeof(addr));
+	}
+	if (status != 0 && fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+static bool sendAll(int fd, const void *data, size_t n) {
+	const char *p = (const char *)data;
+	while (n > 0) {
+		ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		usage();
+		return 1;
+	}
+	bool stats = (strcmp(argv[2], "--stats") == 0);
+	vector<uint8_t> pixels;
+	int width = 0, height = 0;
+	string request;
+	if (stats)
+		request = "STATS\n";
+	else {
+		if (!readOneBitBMP(argv[2], pixels, width, height)) {
+			fprintf (stderr, "Error: Cannot read 1-bit BMP %s.\n", argv[2]);
+			return 1;
+		}
+		string masks = "0", overrides;
+		for (int i = 3; i < argc; ++i) {
+			if (strncmp(argv[i], "masks=", 6) == 0)
+				masks = argv[i] + 6;
+			else
+				overrides += string(" ") + argv[i];
+		}
+		request = "PAGE " + std::to_string(width) + " " + std::to_string(height) + " binary " + masks + overrides + "\n";
+	}
+
+	int fd = connectTo(argv[1]);
+	if (fd < 0) {
+		fprintf (stderr, "Error: Cannot connect to %s.\n", argv[1]);
+		return 1;
+	}
+	// a daemon with too many connections answers BUSY and closes without reading, its answer is still printed
+	if (!sendAll(fd, request.data(), request.size()) || !sendAll(fd, pixels.data(), pixels.size())
+			|| !sendAll(fd, "QUIT\n", 5))
+		fprintf (stderr, "Error: Cannot send the whole request.\n");
+
+	// print the response line by line, skip the bytes of a MASK
+	FILE *in = fdopen(fd, "rb");
+	char line[1024];
+	string first;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		fputs(line, stdout);
+		if (first.empty())
+			first = line;
+		char name[16];
+		long bytes;
+		if (sscanf(line, "MASK %15s %ld", name, &bytes) == 2) {
+			for (long i = 0; i < bytes && fgetc(in) != EOF; ++i) ;
+		}
+	}
+	fclose(in);
+	return (first.compare(0, 2, "OK") == 0 || first.compare(0, 5, "STATS") == 0) ? 0 : 1;
+}
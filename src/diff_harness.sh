@@ -0,0 +1,172 @@
+#!/bin/bash
+# differential check: run a reference build of another revision and the engine of this tree on the same pages,
+# diff every intermediate plane and word image (dumpall), and report the speedup of every stage
+#   diff_harness.sh <reference revision> <work dir> <config> [<manifest>]
+# pages: a synthetic corpus, pathological cases and a stress corpus for worst-case time and memory drawn by engine_bench --page,
+# plus the images of the manifest if given
+# the reference is built once per revision in <work dir>/ref-<commit>, the report is <work dir>/diff_report.txt
+# exit status 1 if any page differs or fails in this engine only, a page failing in the reference only counts as fixed
+
+set -o pipefail
+if [ $# -lt 3 ]; then
+	echo "Usage: diff_harness.sh <reference revision> <work dir> <config> [<manifest>]" >&2
+	exit 2
+fi
+ref=$1
+work=$(mkdir -p "$2" && cd "$2" && pwd)
+config=$3
+manifest=$4
+timeout=${DIFF_TIMEOUT:-600}  # seconds per engine run, a hanging page counts as failed
+memory=${DIFF_MEMORY_MB:-0}   # MB of virtual memory per engine run, 0: no limit
+refFlags=$REF_CPPFLAG         # compiler flags of the reference build if its Makefile's do not suit this compiler
+src=$(cd "$(dirname "$0")" && pwd)
+engine=$src/engine
+
+# build the reference
+root=$(git -C "$src" rev-parse --show-toplevel) || exit 2
+commit=$(git -C "$src" rev-parse --verify "$ref^{commit}") || exit 2
+refdir=$work/ref-$commit
+if [ ! -x "$refdir/src/engine" ]; then
+	echo "Building reference $ref ($commit) ......"
+	rm -rf "$refdir" && mkdir -p "$refdir"
+	git -C "$root" archive "$commit" src default.config | tar -x -C "$refdir" || exit 2
+	make -s -C "$refdir/src" engine ${refFlags:+CPPFLAG="$refFlags"} > "$refdir/build.log" 2>&1 || { tail -20 "$refdir/build.log"; exit 2; }
+fi
+refengine=$refdir/src/engine
+
+# each engine gets the configs it knows, with dumpall outputs, the stage profile if it has one, and no stage cache
+engineConfig() {
+	known=$1
+	out=$2
+	awk 'NR == FNR { if ($1 !~ /^\/\// && NF > 0) known[$1] = 1; next }
+		{ line = $0; sub(/\/\/.*/, "", line); split(line, w, /[ \t]+/); key = (w[1] == "") ? w[2] : w[1]
+		  if (key == "" || (key in known)) print }' "$known" "$config" > "$out"
+	for key in profile stage_cache; do
+		value=$([ $key = profile ] && echo 1 || echo 0)
+		grep -q "^$key[ \t]" "$known" && echo "$key $value" >> "$out"
+	done
+}
+engineConfig "$refdir/default.config" "$work/ref.config"
+engineConfig "$root/default.config" "$work/new.config"
+
+# corpus: <name> <generator parameters>
+corpus=$work/corpus
+mkdir -p "$corpus"
+pages=()
+addPage() {
+	name=$1
+	shift
+	[ -f "$corpus/$name.bmp" ] || "$src/engine_bench" --page "$corpus/$name.bmp" "$@" || exit 2
+	pages+=("$corpus/$name.bmp")
+}
+for dpi in 100 150 300; do
+	for density in 0.5 1 2; do
+		addPage synth_dpi${dpi}_density$density dpi=$dpi density=$density seed=$dpi
+	done
+done
+addPage synth_backslant slant=-0.3 seed=2
+addPage synth_steep slant=0.8 seed=3
+addPage synth_ruled ruling=1 seed=4
+addPage synth_noborder border=0 seed=5
+addPage synth_tight line_spacing=1.6 seed=6
+addPage patho_one_line lines=1 seed=7
+addPage patho_noise noise=200 seed=8
+addPage patho_tiny page_width=0.6 page_height=0.6 margin=0.05 seed=9
+addPage patho_strip page_width=17 page_height=1.2 margin=0.1 lines=1 seed=10
+addPage patho_huge_letters char_height=0.6 seed=11
+addPage patho_blobs density=4 stroke=0.4 seed=12
+addPage stress_black pattern=1
+addPage stress_checkerboard pattern=2
+addPage stress_giant_component pattern=3 seed=13
+addPage stress_empty pattern=4 border=0 noise=0
+addPage stress_specks pattern=4 noise=50 seed=14
+addPage stress_thin page_height=0.1 margin=0.02 lines=1 seed=15
+if [ -n "$manifest" ]; then
+	while read image rest; do
+		[ -z "$image" ] || [ "${image:0:1}" = "#" ] || pages+=("$image")
+	done < "$manifest"
+fi
+
+# run one engine on a page, print "<exit status> <seconds>"
+runEngine() {
+	bin=$1
+	cfg=$2
+	image=$3
+	outdir=$4
+	rm -rf "$outdir" && mkdir -p "$outdir"
+	start=$(date +%s.%N)
+	(
+		[ $memory -gt 0 ] && ulimit -v $((memory * 1024))
+		exec timeout $timeout "$bin" "$cfg" "$image" "$outdir" page 1
+	) > "$outdir.log" 2>&1
+	status=$?
+	echo "$status $(awk -v s=$start -v e=$(date +%s.%N) 'BEGIN { printf "%.3f", e - s }')"
+}
+
+# "<stage> <wall ms>" of a profile, stages of one name summed
+stageTimes() {
+	[ -f "$1" ] && sed -n 's/.*{"name": "\([^"]*\)", "wall_ms": \([0-9.]*\).*/\1 \2/p' "$1"
+}
+
+# peak resident memory of a profile in MB, - without a profile
+peakMB() {
+	[ -f "$1" ] && grep -o '"peak_rss_kb": [0-9]*' "$1" | awk '{ if ($2 > m) m = $2 } END { printf "%.0f", m / 1024 }' || echo -
+}
+
+report=$work/diff_report.txt
+stages=$work/stage_times.txt
+: > "$stages"
+differing=0
+{
+	echo "reference $ref ($commit), config $config"
+	printf "%-40s %-12s %9s %9s %8s %7s  %s\n" page result ref_s new_s speedup new_MB "differing files"
+} > "$report"
+for image in "${pages[@]}"; do
+	name=$(basename "$image" .bmp)
+	out=$work/out/$name
+	read refStatus refSec <<< $(runEngine "$refengine" "$work/ref.config" "$image" "$out/ref")
+	read newStatus newSec <<< $(runEngine "$engine" "$work/new.config" "$image" "$out/new")
+	diffs=""
+	if [ $refStatus -ne 0 ] || [ $newStatus -ne 0 ]; then
+		if [ $refStatus -ne 0 ] && [ $newStatus -ne 0 ]; then
+			result="both_failed"
+		elif [ $newStatus -eq 0 ]; then
+			result="fixed"
+		else
+			result="FAILED"
+			diffs="exit status $refStatus $newStatus"
+			differing=$((differing+1))
+		fi
+	else
+		# every plane and word image, the file names of the words hold their boxes
+		diffs=$(diff -rq -x '*.json' "$out/ref" "$out/new" | sed -e "s|$out/||g" -e 's/^Files \(.*\) and .* differ$/\1/' | tr '\n' ' ')
+		if [ -z "$diffs" ]; then
+			result="match"
+		else
+			result="DIFF"
+			differing=$((differing+1))
+		fi
+		stageTimes "$out/ref/page_profile.json" | sed 's/^/ref /' >> "$stages"
+		stageTimes "$out/new/page_profile.json" | sed 's/^/new /' >> "$stages"
+	fi
+	printf "%-40s %-12s %9.3f %9.3f %7.2fx %7s  %s\n" "$name" $result $refSec $newSec $(awk -v r=$refSec -v n=$newSec 'BEGIN { print (n > 0) ? r / n : 0 }') \
+		$(peakMB "$out/new/page_profile.json") "$diffs" >> "$report"
+	echo "$name: $result"
+done
+
+# stages of both engines summed over all pages, in the order the new engine runs them
+{
+	echo
+	if grep -q "^ref " "$stages"; then
+		printf "%-28s %12s %12s %8s\n" stage ref_ms new_ms speedup
+		awk '{ ms[$1, $2] += $3; if ($1 == "new" && !($2 in seen)) { seen[$2] = 1; order[n++] = $2 } }
+			END { for (i = 0; i < n; ++i) { s = order[i]; r = ms["ref", s]; w = ms["new", s]
+				printf "%-28s %12.1f %12.1f %7s\n", s, r, w, (r > 0 && w > 0) ? sprintf("%.2fx", r / w) : "-" } }' "$stages"
+	else
+		echo "the reference writes no stage profile, only the page times are compared"
+	fi
+	echo
+	echo "$differing of ${#pages[@]} pages differ"
+} >> "$report"
+cat "$report"
+[ $differing -eq 0 ]
@@ -1,67 +1,133 @@
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <map>
+#include <unistd.h>
 #include "HandwrittenImage.h"
 #include "ConfigParser.h"
+#include "ThreadPool.h"
+#include "PageProcessor.h"
+#include "BatchRunner.h"
+#include "WorkQueue.h"
+#include "ResultCache.h"
+#include "ParameterSweep.h"
+#include "BatchReport.h"
+#include "SegmentServer.h"
+#include "Timeline.h"
+#include "PerfCounters.h"
+#include "MsgPrint.h"
 
 using std::string;
 using std::map;
 
+static void usage() {
+	fprintf (stderr, "Usage: engine <config> <image> <outdir> <prefix> <dumpall>\n");
+	fprintf (stderr, "       engine --batch <config> <manifest> <workers> <dumpall>\n");
+	fprintf (stderr, "       engine --queue <config> <manifest> <queue dir> <workers> <dumpall>\n");
+	fprintf (stderr, "       engine --sweep <config> <manifest> <grid> <report>\n");
+	fprintf (stderr, "       engine --serve <config> <address> <workers>\n");
+}
+
+static int runMode(char *argv[], bool batch, bool queue, bool sweep, bool serve, map<string, double> &configs);
+
 int main(int argc, char *argv[]) {
-	if (argc != 6) {
-		fprintf (stderr, "Error: Wrong number of arguments, expected 6, got %d.\n", argc);
+	bool batch = (argc > 1 && strcmp(argv[1], "--batch") == 0);
+	bool queue = (argc > 1 && strcmp(argv[1], "--queue") == 0);
+	bool sweep = (argc > 1 && strcmp(argv[1], "--sweep") == 0);
+	bool serve = (argc > 1 && strcmp(argv[1], "--serve") == 0);
+	int expected = queue ? 7 : (serve ? 5 : 6);
+	if (argc != expected) {
+		fprintf (stderr, "Error: Wrong number of arguments, expected %d, got %d.\n", expected, argc);
+		usage();
 		exit(1);
 	}
-	char *configFile = argv[1];
-	string infile = argv[2];
-	string outdir = argv[3];
-	string prefix = argv[4];
-	bool dumpall = (string(argv[5]) != "0");
-	if (outdir[outdir.length()-1] != '/')
-		outdir += '/';
 	
 	// parse config file
-	ConfigParser configParser(configFile);
+	ConfigParser configParser(argv[(batch || queue || sweep || serve) ? 2 : 1]);
 	map<string, double> configs = configParser.getConfigs();
+	// hardware counters are opened by every thread as it starts, so before the thread pool
+	if (configs["profile"] != 0 && configs["profile_counters"] != 0)
+		PerfCounters::enable();
+	// the timeline is written to <outdir>/<prefix>_timeline.json, in batch modes next to the manifest,
+	// with the pid for a queue as several processes may share one manifest
+	// a daemon has no end of run to write a timeline at
+	string timelineFile;
+	if (configs["timeline"] != 0 && !serve) {
+		Timeline::enable();
+		Timeline::setThreadName("main");
+		if (queue)
+			timelineFile = string(argv[3]) + "_timeline_" + std::to_string(getpid()) + ".json";
+		else if (batch || sweep)
+			timelineFile = string(argv[3]) + "_timeline.json";
+		else
+			timelineFile = string(argv[3]) + (argv[3][strlen(argv[3])-1] == '/' ? "" : "/") + argv[4] + "_timeline.json";
+	}
+	int status = runMode(argv, batch, queue, sweep, serve, configs);
+	if (!timelineFile.empty() && !Timeline::write(timelineFile))
+		MsgPrint::msgPrint(MsgPrint::WARN, ("Cannot write timeline " + timelineFile).c_str());
+	return status;
+}
 
-	HandwrittenImage img;
-	img.readOneBitBMP(infile.c_str());
-	img.removeBorder(configs["border_removal_horizontal_segment_weight"], configs["border_removal_vertial_segment_weight"], configs["border_removal_segment_sum_threshold"]);
-	img.calcCharHeight(configs["charH_convergence_diff"], configs["charH_cutoff_ratio"]);
+static int runMode(char *argv[], bool batch, bool queue, bool sweep, bool serve, map<string, double> &configs) {
+	ThreadPool threadPool(configs["threads"]);
 
-	int charH = img.getCharH();
-	img.blur(configs["blur_width"]*charH, configs["blur_height"]*charH);
+	// pages come from clients of the socket, all workers share the thread pool
+	if (serve) {
+		SegmentServer server(configs, atoi(argv[4]), &threadPool);
+		return server.run(argv[3]);
+	}
 
-	img.initBlurPixFstOrdParDerivY(configs["first_order_partial_derivative_of_y_window_height"]*charH);
-	img.initBlurPixScdOrdParDerivY(configs["second_order_partial_derivative_of_y_window_height"]*charH);
-	img.initSpaceTracingSeeds(configs["space_tracing_seeds_distance"]*charH, configs["space_tracing_seeds_distance"]*charH);
-	img.segmentRegions();
-	img.labelRegions(configs["region_area_min"]*charH*charH, configs["region_black_pixel_percentage_min"], configs["region_black_pixel_percentage_max"]);
-	img.initTextTracingSeeds(configs["text_tracing_seeds_distance"]*charH, configs["text_tracing_seeds_distance"]*charH);
-	img.locateTextLineCenters();
-	img.assignComponentsToRegions();
-	img.slantCorrection();
-	img.genConvexHullComponents();
-	img.extractWord(configs["word_center_strap_width"], configs["word_width_min"]*charH, configs["word_height_min"]*charH,
-			        configs["word_gap_threshold"]*charH, configs["word_alpha"]);
-	img.writeWords((outdir + prefix).c_str());
+	// several processes can work on the same queue, a restarted process resumes where the queue stopped
+	// each process reports its own pages, next to the manifest with its pid
+	if (queue) {
+		vector<PageJob> jobs = BatchRunner::readManifest(argv[3]);
+		WorkQueue workQueue(argv[4], jobs, configs["queue_lease_timeout"]);
+		bool dumpall = (string(argv[6]) != "0");
+		ResultCache resultCache(jobs, configs, dumpall);
+		string suffix = "_" + std::to_string(getpid());
+		BatchReport report(argv[3] + ("_report" + suffix + ".txt"), argv[3] + ("_metrics" + suffix + ".prom"),
+				configs["batch_report"], configs["batch_report_interval"]);
+		BatchRunner runner(configs, atoi(argv[5]), dumpall, &threadPool);
+		if (configs["skip_unchanged_pages"] != 0)
+			runner.setResultCache(&resultCache);
+		if (configs["batch_report"] > 0)
+			runner.setReport(&report);
+		return (runner.run(jobs, &workQueue) == 0) ? 0 : 1;
+	}
+
+	// every page is segmented once, words are extracted once per setting of the grid
+	if (sweep) {
+		vector<PageJob> jobs = BatchRunner::readManifest(argv[3]);
+		ParameterSweep parameterSweep(argv[4], configs);
+		return (parameterSweep.run(jobs, argv[5], &threadPool) == 0) ? 0 : 1;
+	}
 
-	if (dumpall) {
-		//img.writeBMP((outdir + prefix + "_bin.bmp").c_str(), HandwrittenImage::BINPIX);
-		img.writeBMP((outdir + prefix + "_binBR.bmp").c_str(), HandwrittenImage::BINPIXBR);
-		img.writeBMP((outdir + prefix + "_charH.bmp").c_str(), HandwrittenImage::CHARH);
-		img.writeBMP((outdir + prefix + "_blur.bmp").c_str(), HandwrittenImage::BLURPIX);
-		img.writeBMP((outdir + prefix + "_spaceSeeds.bmp").c_str(), HandwrittenImage::SPACETRACINGSEEDS);
-		img.writeBMP((outdir + prefix + "_spaceTraces.bmp").c_str(), HandwrittenImage::SPACETRACES);
-		img.writeBMP((outdir + prefix + "_regions.bmp").c_str(), HandwrittenImage::REGIONS);
-		img.writeBMP((outdir + prefix + "_textSeeds.bmp").c_str(), HandwrittenImage::TEXTTRACINGSEEDS);
-		img.writeBMP((outdir + prefix + "_textTraces.bmp").c_str(), HandwrittenImage::TEXTTRACES);
-		img.writeBMP((outdir + prefix + "_textLines.bmp").c_str(), HandwrittenImage::TEXTLINES);
-		img.writeBMP((outdir + prefix + "_noSlant.bmp").c_str(), HandwrittenImage::NOSLANT);
-		img.writeBMP((outdir + prefix + "_convexHull.bmp").c_str(), HandwrittenImage::CONVEXHULL);
-		img.writeBMP((outdir + prefix + "_words.bmp").c_str(), HandwrittenImage::WORDMAP);
+	if (batch) {
+		vector<PageJob> jobs = BatchRunner::readManifest(argv[3]);
+		bool dumpall = (string(argv[5]) != "0");
+		ResultCache resultCache(jobs, configs, dumpall);
+		BatchReport report(argv[3] + string("_report.txt"), argv[3] + string("_metrics.prom"),
+				configs["batch_report"], configs["batch_report_interval"]);
+		BatchRunner runner(configs, atoi(argv[4]), dumpall, &threadPool);
+		if (configs["skip_unchanged_pages"] != 0)
+			runner.setResultCache(&resultCache);
+		if (configs["batch_report"] > 0)
+			runner.setReport(&report);
+		return (runner.run(jobs) == 0) ? 0 : 1;
 	}
 
+	PageJob job;
+	job.image = argv[2];
+	job.outdir = argv[3];
+	job.prefix = argv[4];
+	bool dumpall = (string(argv[5]) != "0");
+	if (job.outdir[job.outdir.length()-1] != '/')
+		job.outdir += '/';
+
+	HandwrittenImage img;
+	img.setThreadPool(&threadPool);
+	processPage(img, job, configs, dumpall);
+
 	return 0;
 }